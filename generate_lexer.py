@@ -0,0 +1,691 @@
+#!/usr/bin/env python3
+"""
+Lexer generator
+
+Compiles the token specification (lexer.spec) into
+  - lexer_generated.h: the AcceptKind enum, the keyword list, a fingerprint
+    of the spec and scanLexeme(), a goto-threaded scanner for the minimized
+    DFA of all rules
+  - automata_diagrams/*.dot: Graphviz sources of the combined DFA and of the
+    rule groups named by "diagram" lines, rendered to PNG when Graphviz's
+    dot is on the PATH
+
+    python3 generate_lexer.py [--check] [SPEC]
+
+--check writes nothing; it exits with status 1 if lexer_generated.h or a
+diagram source differs from what the spec produces.
+
+The rules are compiled to one NFA (Thompson construction), made
+deterministic over byte classes (subset construction) and minimized by
+partition refinement. Byte sets are 256-bit integers.
+"""
+
+import hashlib
+import os
+import re
+import shutil
+import subprocess
+import sys
+
+ALL_BYTES = (1 << 256) - 1
+
+
+def mask_of(*values):
+    m = 0
+    for b in values:
+        m |= 1 << b
+    return m
+
+
+def mask_range(lo, hi):
+    return ((1 << (hi + 1)) - 1) ^ ((1 << lo) - 1)
+
+
+def bytes_in(mask):
+    return [b for b in range(256) if mask >> b & 1]
+
+
+DIGITS = mask_range(ord('0'), ord('9'))
+ALNUM = mask_range(ord('a'), ord('z')) | mask_range(ord('A'), ord('Z')) | mask_range(ord('0'), ord('9'))
+WHITESPACE = mask_of(ord(' '), ord('\t'), ord('\r'), ord('\n'))
+UNDERSCORE = mask_of(ord('_'))
+
+
+# ---------------------------------------------------------------------------
+# Spec
+# ---------------------------------------------------------------------------
+
+class Spec:
+    def __init__(self):
+        self.kinds = []         # (NAME, description)
+        self.rules = []         # (name, KIND, pattern)
+        self.keywords = []
+        self.diagrams = []      # (file, [rule names])
+
+
+def parse_spec(path):
+    spec = Spec()
+    with open(path) as f:
+        for number, line in enumerate(f, 1):
+            text = line.strip()
+            if not text or text.startswith('#'):
+                continue
+            word = text.split(None, 1)[0]
+            if word == 'kind':
+                parts = text.split(None, 2)
+                spec.kinds.append((parts[1], parts[2] if len(parts) > 2 else ''))
+            elif word == 'rule':
+                parts = text.split(None, 3)
+                if len(parts) != 4:
+                    raise SystemExit('%s:%d: rule needs a name, a kind and a pattern' % (path, number))
+                spec.rules.append((parts[1], parts[2], parts[3]))
+            elif word == 'keywords':
+                spec.keywords.extend(text.split()[1:])
+            elif word == 'diagram':
+                parts = text.split()
+                spec.diagrams.append((parts[1], parts[2:]))
+            else:
+                raise SystemExit('%s:%d: unknown directive "%s"' % (path, number, word))
+    kind_names = [k for k, _ in spec.kinds]
+    for name, kind, _ in spec.rules:
+        if kind not in kind_names:
+            raise SystemExit('%s: rule %s uses undeclared kind %s' % (path, name, kind))
+    return spec
+
+
+# ---------------------------------------------------------------------------
+# Pattern -> NFA
+# ---------------------------------------------------------------------------
+
+class NFA:
+    def __init__(self):
+        self.edges = []         # per state: [(byte mask, target)]
+        self.eps = []           # per state: [target]
+        self.accept = {}        # state -> rule index
+
+    def state(self):
+        self.edges.append([])
+        self.eps.append([])
+        return len(self.edges) - 1
+
+
+class PatternParser:
+    """Recursive descent over one pattern; every method returns an NFA
+    fragment (start, end)."""
+
+    def __init__(self, nfa, pattern):
+        self.nfa = nfa
+        self.text = pattern
+        self.pos = 0
+
+    def fail(self, message):
+        raise SystemExit('pattern %r, column %d: %s' % (self.text, self.pos + 1, message))
+
+    def peek(self):
+        return self.text[self.pos] if self.pos < len(self.text) else None
+
+    def take(self):
+        c = self.peek()
+        if c is None:
+            self.fail('unexpected end')
+        self.pos += 1
+        return c
+
+    def parse(self):
+        frag = self.alternation()
+        if self.peek() is not None:
+            self.fail('unexpected "%s"' % self.peek())
+        return frag
+
+    def alternation(self):
+        branches = [self.sequence()]
+        while self.peek() == '|':
+            self.pos += 1
+            branches.append(self.sequence())
+        if len(branches) == 1:
+            return branches[0]
+        s, e = self.nfa.state(), self.nfa.state()
+        for bs, be in branches:
+            self.nfa.eps[s].append(bs)
+            self.nfa.eps[be].append(e)
+        return s, e
+
+    def sequence(self):
+        s = e = self.nfa.state()
+        while self.peek() not in (None, '|', ')'):
+            fs, fe = self.repeat()
+            self.nfa.eps[e].append(fs)
+            e = fe
+        return s, e
+
+    def repeat(self):
+        fs, fe = self.atom()
+        while self.peek() in ('*', '+', '?'):
+            op = self.take()
+            s, e = self.nfa.state(), self.nfa.state()
+            self.nfa.eps[s].append(fs)
+            self.nfa.eps[fe].append(e)
+            if op in '*?':
+                self.nfa.eps[s].append(e)
+            if op in '*+':
+                self.nfa.eps[fe].append(fs)
+            fs, fe = s, e
+        return fs, fe
+
+    def atom(self):
+        c = self.take()
+        if c == '(':
+            frag = self.alternation()
+            if self.take() != ')':
+                self.fail('missing )')
+            return frag
+        if c == '[':
+            mask = self.byte_set()
+        elif c == '.':
+            mask = ALL_BYTES
+        elif c == '\\':
+            mask = mask_of(self.escape())
+        elif c in '*+?)|':
+            self.fail('nothing to repeat or close')
+        else:
+            mask = mask_of(ord(c))
+        s, e = self.nfa.state(), self.nfa.state()
+        self.nfa.edges[s].append((mask, e))
+        return s, e
+
+    def escape(self):
+        c = self.take()
+        if c == 'x':
+            digits = self.take() + self.take()
+            return int(digits, 16)
+        return ord({'n': '\n', 't': '\t', 'r': '\r'}.get(c, c))
+
+    def set_char(self):
+        c = self.take()
+        return self.escape() if c == '\\' else ord(c)
+
+    def byte_set(self):
+        negate = self.peek() == '^'
+        if negate:
+            self.pos += 1
+        mask = 0
+        first = True
+        while first or self.peek() != ']':
+            first = False
+            lo = self.set_char()
+            if self.peek() == '-' and self.pos + 1 < len(self.text) and self.text[self.pos + 1] != ']':
+                self.pos += 1
+                mask |= mask_range(lo, self.set_char())
+            else:
+                mask |= mask_of(lo)
+        self.take()
+        return ALL_BYTES & ~mask if negate else mask
+
+
+def build_nfa(patterns):
+    """One NFA for a list of (pattern, accept value); earlier entries win."""
+    nfa = NFA()
+    start = nfa.state()
+    for index, pattern in enumerate(patterns):
+        s, e = PatternParser(nfa, pattern).parse()
+        nfa.eps[start].append(s)
+        nfa.accept[e] = index
+    return nfa, start
+
+
+# ---------------------------------------------------------------------------
+# NFA -> minimized DFA
+# ---------------------------------------------------------------------------
+
+def byte_classes(masks):
+    """Coarsest partition of the bytes in which every mask is a union of
+    classes, as a list of masks ordered by their lowest byte."""
+    classes = [ALL_BYTES]
+    for m in set(masks):
+        split = []
+        for c in classes:
+            for part in (c & m, c & ~m):
+                if part:
+                    split.append(part)
+        classes = split
+    return sorted(classes, key=lambda c: (c & -c).bit_length())
+
+
+class DFA:
+    def __init__(self, classes):
+        self.classes = classes  # byte masks
+        self.next = []          # per state: per class target or None
+        self.accept = []        # per state: accept value or None
+
+
+def closure(nfa, states):
+    todo = list(states)
+    seen = set(states)
+    while todo:
+        for t in nfa.eps[todo.pop()]:
+            if t not in seen:
+                seen.add(t)
+                todo.append(t)
+    return frozenset(seen)
+
+
+def determinize(nfa, start):
+    classes = byte_classes([m for edges in nfa.edges for m, _ in edges])
+    dfa = DFA(classes)
+    ids = {}
+    order = []
+
+    def intern(states):
+        if states not in ids:
+            ids[states] = len(order)
+            order.append(states)
+            dfa.next.append(None)
+            hits = [nfa.accept[s] for s in states if s in nfa.accept]
+            dfa.accept.append(min(hits) if hits else None)
+        return ids[states]
+
+    intern(closure(nfa, [start]))
+    k = 0
+    while k < len(order):
+        row = []
+        for c in classes:
+            b = (c & -c).bit_length() - 1
+            moved = [t for s in order[k] for m, t in nfa.edges[s] if m >> b & 1]
+            row.append(intern(closure(nfa, moved)) if moved else None)
+        dfa.next[k] = row
+        k += 1
+    return dfa
+
+
+def minimize(dfa, label):
+    """Merge states that accept the same label and cannot be told apart by
+    any input. State 0 stays the start state; the others are numbered in
+    breadth-first order. Equal byte classes are merged afterwards."""
+    n = len(dfa.next)
+    block = [label(a) for a in dfa.accept]
+    names = {}
+    block = [names.setdefault(b, len(names)) for b in block]
+    while True:
+        signatures = {}
+        refined = []
+        for s in range(n):
+            sig = (block[s], tuple(block[t] if t is not None else -1 for t in dfa.next[s]))
+            refined.append(signatures.setdefault(sig, len(signatures)))
+        if len(signatures) == len(set(block)):
+            break
+        block = refined
+
+    # Renumber breadth-first from the start state; states[i] is one member
+    # of the block numbered i
+    number = {block[0]: 0}
+    states = [0]
+    k = 0
+    while k < len(states):
+        for t in dfa.next[states[k]]:
+            if t is not None and block[t] not in number:
+                number[block[t]] = len(states)
+                states.append(t)
+        k += 1
+
+    out = DFA(None)
+    columns = []
+    for c in range(len(dfa.classes)):
+        columns.append(tuple(number[block[dfa.next[s][c]]] if dfa.next[s][c] is not None else None
+                             for s in states))
+    merged = {}
+    classes = []
+    for c, col in enumerate(columns):
+        if col in merged:
+            classes[merged[col]] |= dfa.classes[c]
+        else:
+            merged[col] = len(classes)
+            classes.append(dfa.classes[c])
+    out.classes = classes
+    cols = list(merged.keys())
+    out.next = [[cols[c][i] for c in range(len(cols))] for i in range(len(states))]
+    out.accept = [label(dfa.accept[s]) for s in states]
+    return out
+
+
+def compile_rules(patterns, label):
+    nfa, start = build_nfa(patterns)
+    return minimize(determinize(nfa, start), label)
+
+
+def transitions(dfa, s):
+    """Byte mask per target state, in target order."""
+    out = {}
+    for c, t in enumerate(dfa.next[s]):
+        if t is not None:
+            out[t] = out.get(t, 0) | dfa.classes[c]
+    return sorted(out.items())
+
+
+# ---------------------------------------------------------------------------
+# C++ scanner
+# ---------------------------------------------------------------------------
+
+def run_kernel(dfa, s):
+    """How the generated code consumes the self-loop of state s: None, or
+    (kind, argument) for one of the run kernels in main.cpp."""
+    loop = dict(transitions(dfa, s)).get(s, 0)
+    if not loop:
+        return None
+    if loop == WHITESPACE:
+        return ('whitespace', None)
+    if loop == ALNUM | UNDERSCORE:
+        return ('ident', None)
+    if loop == DIGITS:
+        return ('digits', None)
+    if loop == ALNUM:
+        # letters/digits, then '_' into a state that also loops on '_'
+        for t, m in transitions(dfa, s):
+            if m == UNDERSCORE and dict(transitions(dfa, t)).get(t, 0) == ALNUM | UNDERSCORE:
+                return ('ident_split', t)
+    rest = ALL_BYTES & ~loop
+    if rest and rest & (rest - 1) == 0:
+        stop = rest.bit_length() - 1
+        # "*/" closes: '*' leads to a state that loops on '*', finishes on
+        # '/' and returns here on anything else
+        star = [t for t, m in transitions(dfa, s) if m == rest and t != s]
+        if stop == ord('*') and star:
+            after_star = dict((m, t) for t, m in transitions(dfa, star[0]))
+            close = after_star.get(mask_of(ord('/')))
+            other = ALL_BYTES & ~(rest | mask_of(ord('/')))
+            if (close is not None and after_star.get(rest) == star[0] and after_star.get(other) == s
+                    and dfa.accept[star[0]] == dfa.accept[s]):
+                return ('comment_close', close)
+        return ('memchr', stop)
+    return None
+
+
+def lookahead(dfa):
+    """Most bytes the scanner may examine past the end of the lexeme it
+    returns: the byte that stops it, plus any run of non-accepting states
+    it has to try first (the "=:" of "=:=")."""
+    memo = {}
+
+    def trial(s, depth):
+        # bytes read from non-accepting state s until the DFA accepts or dies
+        if depth > len(dfa.next):
+            raise SystemExit('unbounded lookahead: non-accepting cycle through state %d' % s)
+        if s not in memo:
+            memo[s] = 1 + max([trial(t, depth + 1) for t, _ in transitions(dfa, s)
+                               if dfa.accept[t] is None] + [0])
+        return memo[s]
+
+    return max(1 + max([trial(t, 0) for t, _ in transitions(dfa, s) if dfa.accept[t] is None] + [0])
+               for s in range(len(dfa.next)) if dfa.accept[s] is not None)
+
+
+def c_char(b):
+    if b == ord("'") or b == ord('\\'):
+        return "'\\%c'" % b
+    if 32 <= b < 127:
+        return "'%c'" % b
+    return {10: "'\\n'", 9: "'\\t'", 13: "'\\r'"}.get(b, '0x%02X' % b)
+
+
+def emit_scanner(spec, dfa, fingerprint):
+    kinds = ['NONE'] + [k for k, _ in spec.kinds]
+    kernels = [run_kernel(dfa, s) for s in range(len(dfa.next))]
+    tails = set(k[1] for k in kernels if k and k[0] == 'ident_split')
+    out = []
+    w = out.append
+    w('// Generated by generate_lexer.py from lexer.spec; do not edit.')
+    w('// Included by main.cpp after the run kernels.')
+    w('// %d states, %d byte classes.' % (len(dfa.next), len(dfa.classes)))
+    w('')
+    w('// What a state accepts when the DFA stops in it')
+    w('enum AcceptKind {')
+    w('    %-20s// not a token; back up to the last accepting state' % 'ACC_NONE,')
+    for name, desc in spec.kinds:
+        w(('    %-20s// %s' % ('ACC_%s,' % name, desc)) if desc else '    ACC_%s,' % name)
+    w('    NUM_ACCEPT_KINDS')
+    w('};')
+    w('')
+    w('// Keywords: WORD matches that are keywords instead of errors')
+    w('constexpr string_view keywordList[] = {')
+    for k in range(0, len(spec.keywords), 8):
+        line = ', '.join('"%s"' % word for word in spec.keywords[k:k + 8])
+        w('    %s%s' % (line, ',' if k + 8 < len(spec.keywords) else ''))
+    w('};')
+    w('')
+    w('// Bytes scanLexeme() may examine past the end of the lexeme it returns;')
+    w('// a lexeme that ends this close to the end of the data may still grow')
+    w('const size_t LEX_LOOKAHEAD = %d;' % lookahead(dfa))
+    w('')
+    w('// Hash of lexer.spec and of the generator that compiled it; results')
+    w('// cached by an older lexer are not reused (see ResultCache)')
+    w('const uint64_t LEX_SPEC_FINGERPRINT = 0x%016xull;' % fingerprint)
+    w('')
+    w('// Byte -> DFA input class')
+    w('const unsigned char lexByteClass[256] = {')
+    cls = [0] * 256
+    for c, m in enumerate(dfa.classes):
+        for b in bytes_in(m):
+            cls[b] = c
+    for row in range(0, 256, 16):
+        w('    %s,' % ', '.join('%2d' % c for c in cls[row:row + 16]))
+    w('};')
+    w('')
+    w('// Scan one lexeme starting at i with maximal munch: remember the last')
+    w('// accepting state and fall back to it when the automaton dies. Returns')
+    w('// the end of the lexeme and stores its AcceptKind in kind.')
+    w('inline size_t scanLexeme(const char* src, size_t i, size_t n, int& kind) {')
+    w('    int lastKind = ACC_NONE;')
+    w('    size_t lastEnd = i;')
+    w('    bool underscore;')
+    blocks = []
+    for s in range(len(dfa.next)):
+        block = []
+        w = block.append
+        kernel = kernels[s]
+        accept = dfa.accept[s]
+        edges = transitions(dfa, s)
+        if s == 0:
+            w('    // s0: start')
+        else:
+            w('s%d:%s' % (s, '' if accept is None else '  // %s' % kinds[accept]))
+        if kernel:
+            k, arg = kernel
+            if k == 'whitespace':
+                w('    i = runKernels.whitespaceEnd(src, i, n);')
+            elif k == 'ident':
+                w('    i = runKernels.identEnd(src, i, n, &underscore);')
+            elif k == 'ident_split':
+                w('    i = runKernels.identEnd(src, i, n, &underscore);')
+                w('    if (underscore) goto s%d_tail;' % arg)
+            elif k == 'digits':
+                w("    while (i < n && (unsigned char)(src[i] - '0') < 10) i++;")
+            elif k == 'memchr':
+                w('    {')
+                w('        const char* hit = (const char*)memchr(src + i, %s, n - i);' % c_char(arg))
+                w('        i = hit ? (size_t)(hit - src) : n;')
+                w('    }')
+            elif k == 'comment_close':
+                w('    i = runKernels.commentCloseAt(src, i, n);')
+                w('    if (i < n) {')
+                w('        i += 2;')
+                w('        goto s%d;' % arg)
+                w('    }')
+            # the kernel consumed the loop (and for ident_split the '_', for
+            # comment_close everything up to the end of input)
+            if k == 'comment_close':
+                consumed = ALL_BYTES
+            elif k in ('ident', 'ident_split'):
+                consumed = ALNUM | UNDERSCORE
+            else:
+                consumed = dict(edges)[s]
+            edges = [(t, m & ~consumed) for t, m in edges if m & ~consumed]
+        if s in tails:
+            w('s%d_tail:' % s)
+        if accept is not None:
+            w('    lastKind = ACC_%s;' % kinds[accept])
+            w('    lastEnd = i;')
+        if not edges:
+            w('    goto done;')
+            blocks.append(block)
+            continue
+        w('    if (i == n) goto done;')
+        w('    switch (lexByteClass[(unsigned char)src[i]]) {')
+        # when no byte kills the state, the widest edge becomes the default
+        fallback = None
+        if sum(m for _, m in edges) == ALL_BYTES:
+            fallback = max(edges, key=lambda e: bin(e[1]).count('1'))
+            edges.remove(fallback)
+        for t, m in edges:
+            labels = [c for c, cm in enumerate(dfa.classes) if cm & m]
+            w('        %s i++; goto s%d;' % (' '.join('case %d:' % c for c in labels), t))
+        if fallback:
+            w('        default: i++; goto s%d;' % fallback[0])
+        else:
+            w('        default: goto done;')
+        w('    }')
+        blocks.append(block)
+
+    # leave out states the kernels made unreachable
+    reached = set([0])
+    todo = [0]
+    while todo:
+        for target in re.findall(r'goto s(\d+)', '\n'.join(blocks[todo.pop()])):
+            if int(target) not in reached:
+                reached.add(int(target))
+                todo.append(int(target))
+    if not any(kernels[s] and kernels[s][0] in ('ident', 'ident_split') for s in reached):
+        out.remove('    bool underscore;')
+    for s in sorted(reached):
+        out.extend(blocks[s])
+    w = out.append
+    w('done:')
+    w('    kind = lastKind;')
+    w('    return lastEnd;')
+    w('}')
+    return '\n'.join(out) + '\n'
+
+
+# ---------------------------------------------------------------------------
+# Diagrams
+# ---------------------------------------------------------------------------
+
+def label_of(mask):
+    """Compact text for a byte set: ranges, or [^...] for big sets."""
+    def ranges(m):
+        parts = []
+        values = bytes_in(m)
+        k = 0
+        while k < len(values):
+            j = k
+            while j + 1 < len(values) and values[j + 1] == values[j] + 1:
+                j += 1
+            lo, hi = values[k], values[j]
+            name = lambda b: {10: '\\\\n', 9: '\\\\t', 13: '\\\\r', 32: 'space', 34: '\\"', 92: '\\\\\\\\'}.get(
+                b, chr(b) if 32 < b < 127 else '0x%02X' % b)
+            if hi - lo >= 3:
+                parts.append('%s-%s' % (name(lo), name(hi)))
+            else:
+                parts.extend(name(b) for b in range(lo, hi + 1))
+            k = j + 1
+        return ' '.join(parts)
+    if mask == ALL_BYTES:
+        return 'any'
+    if bin(mask).count('1') > 128:
+        return '^' + ranges(ALL_BYTES & ~mask)
+    return ranges(mask)
+
+
+def dot_source(title, dfa, names):
+    lines = ['// Generated by generate_lexer.py from lexer.spec; do not edit.',
+             'digraph {', '    label="%s"' % title, '    rankdir=LR', '    node [shape=circle]']
+    for s in range(len(dfa.next)):
+        accept = dfa.accept[s]
+        text = 'q%d' % s + ('\\n(start)' if s == 0 else '')
+        if accept is not None:
+            lines.append('    q%d [label="%s\\n%s" shape=doublecircle]' % (s, text, names[accept]))
+        else:
+            lines.append('    q%d [label="%s"]' % (s, text))
+    for s in range(len(dfa.next)):
+        for t, m in transitions(dfa, s):
+            lines.append('    q%d -> q%d [label="%s"]' % (s, t, label_of(m)))
+    lines.append('}')
+    return '\n'.join(lines) + '\n'
+
+
+def write_output(path, source):
+    with open(path, 'w') as f:
+        f.write(source)
+    if not path.endswith('.dot'):
+        print('Generated: %s' % path)
+    elif shutil.which('dot') is None:
+        print('Generated: %s (install Graphviz to render PNGs)' % path)
+    else:
+        png = path[:-len('.dot')] + '.png'
+        subprocess.run(['dot', '-Tpng', '-o', png, path], check=True)
+        print('Generated: %s and %s' % (path, png))
+
+
+def is_current(path, source):
+    try:
+        with open(path) as f:
+            return f.read() == source
+    except OSError:
+        return False
+
+
+def escape_literal(word):
+    return ''.join('\\' + c if c in '\\[]().*+?|' else c for c in word)
+
+
+def main():
+    here = os.path.dirname(os.path.abspath(__file__))
+    args = sys.argv[1:]
+    check = '--check' in args
+    args = [a for a in args if a != '--check']
+    spec_path = args[0] if args else os.path.join(here, 'lexer.spec')
+    spec = parse_spec(spec_path)
+    digest = hashlib.sha256()
+    for path in (spec_path, os.path.abspath(__file__)):
+        with open(path, 'rb') as f:
+            digest.update(f.read())
+    fingerprint = int.from_bytes(digest.digest()[:8], 'little')
+    kinds = ['NONE'] + [k for k, _ in spec.kinds]
+    kind_of = dict((k, i) for i, k in enumerate(kinds))
+
+    outputs = []                # (path, source)
+    rule_kinds = [kind_of[kind] for _, kind, _ in spec.rules]
+    scanner = compile_rules([p for _, _, p in spec.rules],
+                            lambda r: None if r is None else rule_kinds[r])
+    outputs.append((os.path.join(here, 'lexer_generated.h'),
+                    emit_scanner(spec, scanner, fingerprint)))
+
+    directory = os.path.join(here, 'automata_diagrams')
+    outputs.append((os.path.join(directory, 'complete_lexer_dfa.dot'),
+                    dot_source('Complete lexer DFA', scanner, kinds)))
+    rules = dict((name, (kind, pattern)) for name, kind, pattern in spec.rules)
+    for name, members in spec.diagrams:
+        patterns, names = [], []
+        for member in members:
+            if member == '@keywords':
+                patterns.append('|'.join(escape_literal(w) for w in spec.keywords))
+                names.append('KEYWORD')
+            elif member in rules:
+                patterns.append(rules[member][1])
+                names.append(rules[member][0])
+            else:
+                raise SystemExit('diagram %s: unknown rule %s' % (name, member))
+        dfa = compile_rules(patterns, lambda r: r)
+        outputs.append((os.path.join(directory, name + '.dot'),
+                        dot_source('rules: ' + ', '.join(members), dfa, names)))
+
+    if check:
+        stale = [path for path, source in outputs if not is_current(path, source)]
+        for path in stale:
+            print('Stale: %s (run python3 generate_lexer.py)' % os.path.relpath(path, here))
+        sys.exit(1 if stale else 0)
+    os.makedirs(directory, exist_ok=True)
+    for path, source in outputs:
+        write_output(path, source)
+
+
+if __name__ == '__main__':
+    main()
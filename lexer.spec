@@ -0,0 +1,75 @@
+# Token specification for the lexical analyzer
+#
+# This file is the only description of the token rules. generate_lexer.py
+# compiles it into lexer_generated.h (the scanner and keyword list used by
+# main.cpp) and into the diagrams in automata_diagrams/. Run
+#
+#     python3 generate_lexer.py
+#
+# after every change and commit the regenerated files with it.
+#
+# Directives, one per line:
+#
+#   kind NAME description         an accept kind; becomes ACC_NAME in the
+#                                 AcceptKind enum, in the order listed
+#   rule name KIND pattern        a token rule; the pattern is the rest of
+#                                 the line. The scanner takes the longest
+#                                 match, and the earliest rule on a tie.
+#   keywords word...              words that turn a WORD match into a keyword
+#   diagram file rule...          draw the DFA of these rules (@keywords: the
+#                                 keyword list) to automata_diagrams/file
+#
+# Patterns: characters match themselves; \n \t \r \xHH and \<char> are
+# escapes; [...] is a set with ranges and ^ for the complement; . is any
+# byte; ( ) | * + ? as usual. Spaces only match inside [...] or as "\ ".
+
+kind SKIP           whitespace
+kind COMMENT        skipped like whitespace; kept apart for LexStats
+kind WORD           identifier-shaped without underscore: keyword or error
+kind IDENT
+kind NUMBER
+kind OPERATOR
+kind PUNCT
+kind ERROR          unrecognized character
+kind BAD_NUMBER     "1.", "2E", "3E+" ...: reported like ACC_ERROR
+kind BAD_OPERATOR   '=', '!', '&' or '|' alone: reported like ACC_ERROR
+kind UNTERMINATED   end of input inside /* */
+
+rule whitespace             SKIP            [ \t\r\n]+
+rule line_comment           COMMENT         //[^\n]*
+rule block_comment          COMMENT         /\*([^*]|\*+[^*/])*\*+/
+rule unterminated_comment   UNTERMINATED    /\*([^*]|\*+[^*/])*\**
+
+# Identifiers must contain an underscore; without one the word is looked up
+# in the keyword list and is an error if it is not there
+rule identifier             IDENT           ([A-Za-z][A-Za-z0-9]*)?_[A-Za-z0-9_]*
+rule word                   WORD            [A-Za-z][A-Za-z0-9]*
+
+# [+-]?(D+)(\.D+)?(E[+-]?D+)? and the prefixes that cannot be completed
+rule number                 NUMBER          [+-]?[0-9]+(\.[0-9]+)?([Ee][+-]?[0-9]+)?
+rule bad_number             BAD_NUMBER      [+-]?[0-9]+(\.|(\.[0-9]+)?[Ee][+-]?)
+
+rule operator               OPERATOR        \+\+|--|==|=\+|=>|=<|=:=|!=|<>|>>|::|&&|\|\||[-+*/%:]
+rule bad_operator           BAD_OPERATOR    [=!&|]
+
+# A single < or > is a bracket; << is two of them
+rule punctuation            PUNCT           [{}()\[\],;<>]
+
+rule error                  ERROR           .
+
+keywords loop agar magar asm else new this auto
+keywords enum operator throw bool explicit private true
+keywords break export protected try case extern public
+keywords typedef catch false register typeid char float
+keywords typename class for return union const friend
+keywords short unsigned goto signed using continue if
+keywords sizeof virtual default inline static void delete
+keywords int volatile do long struct double mutable
+keywords switch while namespace
+
+diagram identifier_dfa      identifier word
+diagram number_dfa          number bad_number
+diagram operator_nfa        operator bad_operator
+diagram punctuation_dfa     punctuation
+diagram comment_dfa         line_comment block_comment unterminated_comment
+diagram keyword_dfa         @keywords
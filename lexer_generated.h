@@ -0,0 +1,273 @@
+// Generated by generate_lexer.py from lexer.spec; do not edit.
+// Included by main.cpp after the run kernels.
+// 27 states, 21 byte classes.
+
+// What a state accepts when the DFA stops in it
+enum AcceptKind {
+    ACC_NONE,           // not a token; back up to the last accepting state
+    ACC_SKIP,           // whitespace
+    ACC_COMMENT,        // skipped like whitespace; kept apart for LexStats
+    ACC_WORD,           // identifier-shaped without underscore: keyword or error
+    ACC_IDENT,
+    ACC_NUMBER,
+    ACC_OPERATOR,
+    ACC_PUNCT,
+    ACC_ERROR,          // unrecognized character
+    ACC_BAD_NUMBER,     // "1.", "2E", "3E+" ...: reported like ACC_ERROR
+    ACC_BAD_OPERATOR,   // '=', '!', '&' or '|' alone: reported like ACC_ERROR
+    ACC_UNTERMINATED,   // end of input inside /* */
+    NUM_ACCEPT_KINDS
+};
+
+// Keywords: WORD matches that are keywords instead of errors
+constexpr string_view keywordList[] = {
+    "loop", "agar", "magar", "asm", "else", "new", "this", "auto",
+    "enum", "operator", "throw", "bool", "explicit", "private", "true", "break",
+    "export", "protected", "try", "case", "extern", "public", "typedef", "catch",
+    "false", "register", "typeid", "char", "float", "typename", "class", "for",
+    "return", "union", "const", "friend", "short", "unsigned", "goto", "signed",
+    "using", "continue", "if", "sizeof", "virtual", "default", "inline", "static",
+    "void", "delete", "int", "volatile", "do", "long", "struct", "double",
+    "mutable", "switch", "while", "namespace"
+};
+
+// Bytes scanLexeme() may examine past the end of the lexeme it returns;
+// a lexeme that ends this close to the end of the data may still grow
+const size_t LEX_LOOKAHEAD = 2;
+
+// Hash of lexer.spec and of the generator that compiled it; results
+// cached by an older lexer are not reused (see ResultCache)
+const uint64_t LEX_SPEC_FINGERPRINT = 0x0c0a1d1d31e1601aull;
+
+// Byte -> DFA input class
+const unsigned char lexByteClass[256] = {
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  1,  2,  0,  0,  1,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     1,  3,  0,  0,  0,  4,  5,  0,  6,  6,  7,  8,  6,  9, 10, 11,
+    12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 13,  6, 14, 15, 16,  0,
+     0, 17, 17, 17, 17, 18, 17, 17, 17, 17, 17, 17, 17, 17, 17, 17,
+    17, 17, 17, 17, 17, 17, 17, 17, 17, 17, 17,  6,  0,  6,  0, 19,
+     0, 17, 17, 17, 17, 18, 17, 17, 17, 17, 17, 17, 17, 17, 17, 17,
+    17, 17, 17, 17, 17, 17, 17, 17, 17, 17, 17,  6, 20,  6,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+};
+
+// Scan one lexeme starting at i with maximal munch: remember the last
+// accepting state and fall back to it when the automaton dies. Returns
+// the end of the lexeme and stores its AcceptKind in kind.
+inline size_t scanLexeme(const char* src, size_t i, size_t n, int& kind) {
+    int lastKind = ACC_NONE;
+    size_t lastEnd = i;
+    bool underscore;
+    // s0: start
+    if (i == n) goto done;
+    switch (lexByteClass[(unsigned char)src[i]]) {
+        case 1: case 2: i++; goto s2;
+        case 3: i++; goto s3;
+        case 4: case 7: i++; goto s4;
+        case 5: i++; goto s5;
+        case 6: i++; goto s6;
+        case 8: i++; goto s7;
+        case 9: i++; goto s8;
+        case 11: i++; goto s9;
+        case 12: i++; goto s10;
+        case 13: i++; goto s11;
+        case 14: case 16: i++; goto s12;
+        case 15: i++; goto s13;
+        case 17: case 18: i++; goto s14;
+        case 19: i++; goto s15;
+        case 20: i++; goto s16;
+        default: i++; goto s1;
+    }
+s1:  // ERROR
+    lastKind = ACC_ERROR;
+    lastEnd = i;
+    goto done;
+s2:  // SKIP
+    i = runKernels.whitespaceEnd(src, i, n);
+    lastKind = ACC_SKIP;
+    lastEnd = i;
+    goto done;
+s3:  // BAD_OPERATOR
+    lastKind = ACC_BAD_OPERATOR;
+    lastEnd = i;
+    if (i == n) goto done;
+    switch (lexByteClass[(unsigned char)src[i]]) {
+        case 15: i++; goto s4;
+        default: goto done;
+    }
+s4:  // OPERATOR
+    lastKind = ACC_OPERATOR;
+    lastEnd = i;
+    goto done;
+s5:  // BAD_OPERATOR
+    lastKind = ACC_BAD_OPERATOR;
+    lastEnd = i;
+    if (i == n) goto done;
+    switch (lexByteClass[(unsigned char)src[i]]) {
+        case 5: i++; goto s4;
+        default: goto done;
+    }
+s6:  // PUNCT
+    lastKind = ACC_PUNCT;
+    lastEnd = i;
+    goto done;
+s7:  // OPERATOR
+    lastKind = ACC_OPERATOR;
+    lastEnd = i;
+    if (i == n) goto done;
+    switch (lexByteClass[(unsigned char)src[i]]) {
+        case 8: i++; goto s4;
+        case 12: i++; goto s10;
+        default: goto done;
+    }
+s8:  // OPERATOR
+    lastKind = ACC_OPERATOR;
+    lastEnd = i;
+    if (i == n) goto done;
+    switch (lexByteClass[(unsigned char)src[i]]) {
+        case 9: i++; goto s4;
+        case 12: i++; goto s10;
+        default: goto done;
+    }
+s9:  // OPERATOR
+    lastKind = ACC_OPERATOR;
+    lastEnd = i;
+    if (i == n) goto done;
+    switch (lexByteClass[(unsigned char)src[i]]) {
+        case 7: i++; goto s17;
+        case 11: i++; goto s18;
+        default: goto done;
+    }
+s10:  // NUMBER
+    while (i < n && (unsigned char)(src[i] - '0') < 10) i++;
+    lastKind = ACC_NUMBER;
+    lastEnd = i;
+    if (i == n) goto done;
+    switch (lexByteClass[(unsigned char)src[i]]) {
+        case 10: i++; goto s19;
+        case 18: i++; goto s20;
+        default: goto done;
+    }
+s11:  // OPERATOR
+    lastKind = ACC_OPERATOR;
+    lastEnd = i;
+    if (i == n) goto done;
+    switch (lexByteClass[(unsigned char)src[i]]) {
+        case 13: i++; goto s4;
+        default: goto done;
+    }
+s12:  // PUNCT
+    lastKind = ACC_PUNCT;
+    lastEnd = i;
+    if (i == n) goto done;
+    switch (lexByteClass[(unsigned char)src[i]]) {
+        case 16: i++; goto s4;
+        default: goto done;
+    }
+s13:  // BAD_OPERATOR
+    lastKind = ACC_BAD_OPERATOR;
+    lastEnd = i;
+    if (i == n) goto done;
+    switch (lexByteClass[(unsigned char)src[i]]) {
+        case 8: case 14: case 15: case 16: i++; goto s4;
+        case 13: i++; goto s21;
+        default: goto done;
+    }
+s14:  // WORD
+    i = runKernels.identEnd(src, i, n, &underscore);
+    if (underscore) goto s15_tail;
+    lastKind = ACC_WORD;
+    lastEnd = i;
+    goto done;
+s15:  // IDENT
+    i = runKernels.identEnd(src, i, n, &underscore);
+s15_tail:
+    lastKind = ACC_IDENT;
+    lastEnd = i;
+    goto done;
+s16:  // BAD_OPERATOR
+    lastKind = ACC_BAD_OPERATOR;
+    lastEnd = i;
+    if (i == n) goto done;
+    switch (lexByteClass[(unsigned char)src[i]]) {
+        case 20: i++; goto s4;
+        default: goto done;
+    }
+s17:  // UNTERMINATED
+    i = runKernels.commentCloseAt(src, i, n);
+    if (i < n) {
+        i += 2;
+        goto s26;
+    }
+    lastKind = ACC_UNTERMINATED;
+    lastEnd = i;
+    goto done;
+s18:  // COMMENT
+    {
+        const char* hit = (const char*)memchr(src + i, '\n', n - i);
+        i = hit ? (size_t)(hit - src) : n;
+    }
+    lastKind = ACC_COMMENT;
+    lastEnd = i;
+    goto done;
+s19:  // BAD_NUMBER
+    lastKind = ACC_BAD_NUMBER;
+    lastEnd = i;
+    if (i == n) goto done;
+    switch (lexByteClass[(unsigned char)src[i]]) {
+        case 12: i++; goto s23;
+        default: goto done;
+    }
+s20:  // BAD_NUMBER
+    lastKind = ACC_BAD_NUMBER;
+    lastEnd = i;
+    if (i == n) goto done;
+    switch (lexByteClass[(unsigned char)src[i]]) {
+        case 8: case 9: i++; goto s24;
+        case 12: i++; goto s25;
+        default: goto done;
+    }
+s21:
+    if (i == n) goto done;
+    switch (lexByteClass[(unsigned char)src[i]]) {
+        case 15: i++; goto s4;
+        default: goto done;
+    }
+s23:  // NUMBER
+    while (i < n && (unsigned char)(src[i] - '0') < 10) i++;
+    lastKind = ACC_NUMBER;
+    lastEnd = i;
+    if (i == n) goto done;
+    switch (lexByteClass[(unsigned char)src[i]]) {
+        case 18: i++; goto s20;
+        default: goto done;
+    }
+s24:  // BAD_NUMBER
+    lastKind = ACC_BAD_NUMBER;
+    lastEnd = i;
+    if (i == n) goto done;
+    switch (lexByteClass[(unsigned char)src[i]]) {
+        case 12: i++; goto s25;
+        default: goto done;
+    }
+s25:  // NUMBER
+    while (i < n && (unsigned char)(src[i] - '0') < 10) i++;
+    lastKind = ACC_NUMBER;
+    lastEnd = i;
+    goto done;
+s26:  // COMMENT
+    lastKind = ACC_COMMENT;
+    lastEnd = i;
+    goto done;
+done:
+    kind = lastKind;
+    return lastEnd;
+}
@@ -1,421 +1,4668 @@
 #include <iostream>
+#include <chrono>
 #include <fstream>
 #include <cctype>
+#include <cerrno>
+#include <cstdlib>
 #include <cstring>
+#include <new>
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <atomic>
+#include <filesystem>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <cstdint>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#if !defined(LEXER_NO_SIMD) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define LEXER_HAVE_X86_SIMD 1
+#endif
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define LEXER_HAVE_MMAP 1
+#endif
 using namespace std;
 
-const int MAX_TOKENS = 1000;
-const int MAX_ERRORS = 500;
+// ---------------------------------------------------------------------------
+// Run kernels
+//
+// Whitespace, comments and identifiers are long self-loops in the DFA. Once
+// the scanner enters one of those states, a kernel finds the end of the run
+// 16 (SSE2) or 32 (AVX2) bytes at a time instead of stepping the DFA per
+// byte. AVX2 is picked at runtime; other targets, and builds with
+// -DLEXER_NO_SIMD, use the scalar loops.
+// ---------------------------------------------------------------------------
 
+inline bool isWhitespaceByte(unsigned char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+inline bool isIdentByte(unsigned char c) {
+    return (unsigned char)((c | 0x20) - 'a') < 26 || (unsigned char)(c - '0') < 10 || c == '_';
+}
+
+size_t scalarWhitespaceEnd(const char* p, size_t i, size_t n) {
+    while (i < n && isWhitespaceByte(p[i])) i++;
+    return i;
+}
+
+size_t scalarIdentEnd(const char* p, size_t i, size_t n, bool* underscore) {
+    bool seen = false;
+    while (i < n && isIdentByte(p[i])) {
+        seen |= (p[i] == '_');
+        i++;
+    }
+    *underscore = seen;
+    return i;
+}
+
+// Position of the first "*/" at or after i, or n
+size_t scalarCommentCloseAt(const char* p, size_t i, size_t n) {
+    while (i + 1 < n) {
+        const char* star = (const char*)memchr(p + i, '*', n - 1 - i);
+        if (!star) break;
+        i = star - p;
+        if (p[i + 1] == '/') return i;
+        i++;
+    }
+    return n;
+}
+
+#ifdef LEXER_HAVE_X86_SIMD
+
+// In every kernel bit k of the movemask is set when byte k of the block
+// belongs to the run.
+
+size_t sse2WhitespaceEnd(const char* p, size_t i, size_t n) {
+    while (i + 16 <= n) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(p + i));
+        __m128i ws = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))),
+                                  _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\r')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'))));
+        unsigned m = _mm_movemask_epi8(ws);
+        if (m != 0xFFFF) return i + __builtin_ctz(~m);
+        i += 16;
+    }
+    return scalarWhitespaceEnd(p, i, n);
+}
+
+size_t sse2IdentEnd(const char* p, size_t i, size_t n, bool* underscore) {
+    // letters: (c | 0x20) - 'a' < 26, digits: c - '0' < 10, done as signed
+    // compares after biasing the range down to -128
+    const __m128i lowerBias = _mm_set1_epi8((char)(128 - 'a'));
+    const __m128i digitBias = _mm_set1_epi8((char)(128 - '0'));
+    const __m128i letterLimit = _mm_set1_epi8((char)(-128 + 26));
+    const __m128i digitLimit = _mm_set1_epi8((char)(-128 + 10));
+    const __m128i caseBit = _mm_set1_epi8(0x20);
+    const __m128i us = _mm_set1_epi8('_');
+    bool seen = false;
+    while (i + 16 <= n) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(p + i));
+        __m128i letter = _mm_cmpgt_epi8(letterLimit, _mm_add_epi8(_mm_or_si128(v, caseBit), lowerBias));
+        __m128i digit = _mm_cmpgt_epi8(digitLimit, _mm_add_epi8(v, digitBias));
+        __m128i under = _mm_cmpeq_epi8(v, us);
+        unsigned m = _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(letter, digit), under));
+        unsigned u = _mm_movemask_epi8(under);
+        if (m != 0xFFFF) {
+            unsigned len = __builtin_ctz(~m);
+            *underscore = seen || (u & ((1u << len) - 1)) != 0;
+            return i + len;
+        }
+        seen |= (u != 0);
+        i += 16;
+    }
+    size_t end = scalarIdentEnd(p, i, n, underscore);
+    *underscore |= seen;
+    return end;
+}
+
+size_t sse2CommentCloseAt(const char* p, size_t i, size_t n) {
+    const __m128i star = _mm_set1_epi8('*');
+    const __m128i slash = _mm_set1_epi8('/');
+    while (i + 17 <= n) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(p + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(p + i + 1));
+        unsigned m = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, star), _mm_cmpeq_epi8(b, slash)));
+        if (m) return i + __builtin_ctz(m);
+        i += 16;
+    }
+    return scalarCommentCloseAt(p, i, n);
+}
+
+__attribute__((target("avx2")))
+size_t avx2WhitespaceEnd(const char* p, size_t i, size_t n) {
+    while (i + 32 <= n) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(p + i));
+        __m256i ws = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))),
+                                     _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'))));
+        unsigned m = _mm256_movemask_epi8(ws);
+        if (m != 0xFFFFFFFFu) return i + __builtin_ctz(~m);
+        i += 32;
+    }
+    return sse2WhitespaceEnd(p, i, n);
+}
+
+__attribute__((target("avx2")))
+size_t avx2IdentEnd(const char* p, size_t i, size_t n, bool* underscore) {
+    const __m256i lowerBias = _mm256_set1_epi8((char)(128 - 'a'));
+    const __m256i digitBias = _mm256_set1_epi8((char)(128 - '0'));
+    const __m256i letterLimit = _mm256_set1_epi8((char)(-128 + 26));
+    const __m256i digitLimit = _mm256_set1_epi8((char)(-128 + 10));
+    const __m256i caseBit = _mm256_set1_epi8(0x20);
+    const __m256i us = _mm256_set1_epi8('_');
+    bool seen = false;
+    while (i + 32 <= n) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(p + i));
+        __m256i letter = _mm256_cmpgt_epi8(letterLimit, _mm256_add_epi8(_mm256_or_si256(v, caseBit), lowerBias));
+        __m256i digit = _mm256_cmpgt_epi8(digitLimit, _mm256_add_epi8(v, digitBias));
+        __m256i under = _mm256_cmpeq_epi8(v, us);
+        unsigned m = _mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(letter, digit), under));
+        unsigned u = _mm256_movemask_epi8(under);
+        if (m != 0xFFFFFFFFu) {
+            unsigned len = __builtin_ctz(~m);
+            *underscore = seen || (u & ((1u << len) - 1)) != 0;
+            return i + len;
+        }
+        seen |= (u != 0);
+        i += 32;
+    }
+    size_t end = sse2IdentEnd(p, i, n, underscore);
+    *underscore |= seen;
+    return end;
+}
+
+__attribute__((target("avx2")))
+size_t avx2CommentCloseAt(const char* p, size_t i, size_t n) {
+    const __m256i star = _mm256_set1_epi8('*');
+    const __m256i slash = _mm256_set1_epi8('/');
+    while (i + 33 <= n) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(p + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(p + i + 1));
+        unsigned m = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, star), _mm256_cmpeq_epi8(b, slash)));
+        if (m) return i + __builtin_ctz(m);
+        i += 32;
+    }
+    return sse2CommentCloseAt(p, i, n);
+}
+
+#endif
+
+struct RunKernels {
+    size_t (*whitespaceEnd)(const char*, size_t, size_t);
+    size_t (*identEnd)(const char*, size_t, size_t, bool*);
+    size_t (*commentCloseAt)(const char*, size_t, size_t);
+    const char* name;
+    
+    RunKernels() {
+#ifdef LEXER_HAVE_X86_SIMD
+        if (__builtin_cpu_supports("avx2")) {
+            whitespaceEnd = avx2WhitespaceEnd;
+            identEnd = avx2IdentEnd;
+            commentCloseAt = avx2CommentCloseAt;
+            name = "avx2";
+            return;
+        }
+        whitespaceEnd = sse2WhitespaceEnd;
+        identEnd = sse2IdentEnd;
+        commentCloseAt = sse2CommentCloseAt;
+        name = "sse2";
+#else
+        whitespaceEnd = scalarWhitespaceEnd;
+        identEnd = scalarIdentEnd;
+        commentCloseAt = scalarCommentCloseAt;
+        name = "scalar";
+#endif
+    }
+};
+
+static const RunKernels runKernels;
+
+// ---------------------------------------------------------------------------
+// Scanner
+//
+// The token rules live in lexer.spec. generate_lexer.py compiles them into
+// one minimized DFA (whitespace, comments, identifier, number, operator and
+// punctuation automata behind a single start state) and emits it as
+// lexer_generated.h: the AcceptKind enum, the keyword list and scanLexeme(),
+// in which every state is a label and every transition a jump. States with
+// long self-loops hand the run to the kernels above. Edit the spec and rerun
+// the generator; do not edit the header.
+// ---------------------------------------------------------------------------
+
+#include "lexer_generated.h"
+
+// ---------------------------------------------------------------------------
+// Keyword recognition
+//
+// The keywords are placed in a perfect hash table built at compile time: a
+// word is keyed on its length and its first, second and last characters
+// (unique over the list), the key is multiplied by a seed and the top bits
+// select a slot. The seed is searched by the compiler until no two keywords
+// share a slot, so a lookup is one multiply and at most one comparison.
+// ---------------------------------------------------------------------------
+
+// keywordList comes from lexer.spec
+const int NUM_KEYWORDS = sizeof(keywordList) / sizeof(keywordList[0]);
+const int KEYWORD_MIN_LEN = 2;
+const int KEYWORD_MAX_LEN = 9;
+const int KEYWORD_HASH_BITS = 9;
+
+constexpr bool keywordLengthsInRange() {
+    for (int k = 0; k < NUM_KEYWORDS; ++k) {
+        if ((int)keywordList[k].size() < KEYWORD_MIN_LEN || (int)keywordList[k].size() > KEYWORD_MAX_LEN) {
+            return false;
+        }
+    }
+    return true;
+}
+static_assert(keywordLengthsInRange(), "KEYWORD_MIN_LEN/KEYWORD_MAX_LEN do not cover the keyword list");
+
+// Only called for words of at least KEYWORD_MIN_LEN characters
+constexpr uint32_t keywordKey(string_view s) {
+    return (uint32_t)s.size()
+        | (uint32_t)(unsigned char)s[0] << 8
+        | (uint32_t)(unsigned char)s[1] << 16
+        | (uint32_t)(unsigned char)s[s.size() - 1] << 24;
+}
+
+struct KeywordHash {
+    uint32_t seed = 0;
+    unsigned char slot[1 << KEYWORD_HASH_BITS] = {};   // keyword index + 1, 0 = empty
+    
+    constexpr unsigned slotOf(uint32_t key) const {
+        return (uint32_t)(key * seed) >> (32 - KEYWORD_HASH_BITS);
+    }
+};
+
+constexpr KeywordHash buildKeywordHash() {
+    for (uint32_t attempt = 0; attempt < 100000; ++attempt) {
+        KeywordHash h;
+        h.seed = (0x9E3779B1u + attempt * 0x7F4A7C16u) | 1u;
+        bool collision = false;
+        for (int k = 0; k < NUM_KEYWORDS && !collision; ++k) {
+            unsigned idx = h.slotOf(keywordKey(keywordList[k]));
+            if (h.slot[idx] != 0) {
+                collision = true;
+            } else {
+                h.slot[idx] = (unsigned char)(k + 1);
+            }
+        }
+        if (!collision) {
+            return h;
+        }
+    }
+    return KeywordHash();
+}
+
+constexpr KeywordHash keywordHash = buildKeywordHash();
+static_assert(keywordHash.seed != 0, "no perfect hash seed found for the keyword list");
+
+inline bool lookupKeyword(string_view str) {
+    if (str.size() < KEYWORD_MIN_LEN || str.size() > KEYWORD_MAX_LEN) {
+        return false;
+    }
+    int entry = keywordHash.slot[keywordHash.slotOf(keywordKey(str))];
+    return entry != 0 && keywordList[entry - 1] == str;
+}
+
+// Token types, numbered like the "View Token Types Separately" menu
+enum TokenType : uint8_t {
+    TOK_IDENTIFIER = 1,
+    TOK_NUMBER,
+    TOK_OPERATOR,
+    TOK_PUNCTUATION,
+    TOK_KEYWORD
+};
+const int NUM_TOKEN_TYPES = TOK_KEYWORD + 1;
+
+const char* tokenTypeName(int type) {
+    switch (type) {
+        case TOK_IDENTIFIER: return "Identifier";
+        case TOK_NUMBER: return "Number";
+        case TOK_OPERATOR: return "Operator";
+        case TOK_PUNCTUATION: return "Punctuation";
+        case TOK_KEYWORD: return "Keyword";
+        default: return "Unknown";
+    }
+}
+
+const uint32_t NO_SYMBOL = 0xFFFFFFFFu;
+
+// A token is a position in the analyzer's source buffer; the lexeme is
+// never copied (see LexicalAnalyzer::lexeme()). With symbol interning on,
+// identifiers and numbers also carry the id of their interned text (see
+// SymbolTable); otherwise, and for other tokens, symbol is NO_SYMBOL.
 struct Token {
-    string lexeme;
-    string type;
+    TokenType type;
+    uint32_t offset;
+    uint32_t length;
+    uint32_t symbol;
+};
+
+// Values are stored in binary token files; append new kinds at the end
+enum ErrorKind : uint8_t {
+    ERR_BAD_CHARACTER,
+    ERR_UNTERMINATED_COMMENT,
+    ERR_NO_UNDERSCORE,          // identifier-shaped word that is not a keyword
+    ERR_MALFORMED_NUMBER,       // "1.", "2E", "3E+" ...
+    ERR_INCOMPLETE_OPERATOR,    // '=', '!', '&' or '|' on their own
+    ERR_TOO_MANY_ERRORS         // scan stopped at the max-errors cutoff
+};
+
+const char* errorKindName(int kind) {
+    switch (kind) {
+        case ERR_BAD_CHARACTER: return "unrecognized character";
+        case ERR_UNTERMINATED_COMMENT: return "unterminated comment";
+        case ERR_NO_UNDERSCORE: return "identifier without underscore";
+        case ERR_MALFORMED_NUMBER: return "malformed number";
+        case ERR_INCOMPLETE_OPERATOR: return "incomplete operator";
+        case ERR_TOO_MANY_ERRORS: return "too many errors";
+        default: return "error";
+    }
+}
+
+// Errors are stored as positions like tokens; the line and column are
+// looked up on demand (see LexicalAnalyzer::errorRecord())
+struct LexError {
+    ErrorKind kind;
+    uint32_t offset;
+    uint32_t length;
+};
+
+// An error with its position resolved: line and column count from 1,
+// columns in bytes
+struct ErrorRecord {
+    ErrorKind kind;
+    uint32_t offset;
+    uint32_t line;
+    uint32_t column;
+    uint32_t length;
+};
+
+// Panic-mode error recovery (see LexicalAnalyzer::setErrorRecovery())
+enum RecoveryMode {
+    RECOVER_NONE,               // every error is exactly the rejected lexeme
+    RECOVER_SKIP_TO_DELIMITER   // an error extends to the next delimiter
+};
+
+// Receives tokens and errors while analyze() scans, instead of having them
+// collected in the analyzer. Lets arbitrarily large inputs be lexed without
+// the token list growing with the input. The text views point into the
+// analyzer's source buffer and stay valid until it is replaced; under
+// analyzeStream() they are only valid during the call.
+class TokenSink {
+public:
+    virtual ~TokenSink() {}
+    virtual void onToken(const Token& tok, string_view lexeme) = 0;
+    virtual void onError(const LexError& err, string_view text) = 0;
+    
+    // analyzeStream() keeps no source to look positions up in later, so it
+    // reports errors here with line and column resolved. The default passes
+    // them on to onError() without the position.
+    virtual void onErrorAt(const ErrorRecord& rec, string_view text) {
+        LexError err;
+        err.kind = rec.kind;
+        err.offset = rec.offset;
+        err.length = rec.length;
+        onError(err, text);
+    }
+    
+    // Called by analyzeStream() whenever it has lexed all input read so
+    // far, before it waits for more; a sink that buffers output should pass
+    // it on here
+    virtual void flush() {}
+};
+
+// Gap left in the token or error vector by applyEdit(), so that the next
+// edit nearby moves only the records between the two. Records before the
+// gap hold their offset; the ones after it hold their distance from the end
+// of the source instead, which an edit in front of them does not change.
+// n is always the current source size. Closed, the vector is plain.
+struct RecordGap {
+    bool open;
+    size_t at;      // first unused slot
+    size_t len;     // unused slots
+    
+    RecordGap(): open(false), at(0), len(0) {}
+    
+    template <class Rec>
+    size_t count(const vector<Rec>& recs) const {
+        return recs.size() - (open ? len : 0);
+    }
+    
+    // Record j, gap skipped, with its offset
+    template <class Rec>
+    Rec get(const vector<Rec>& recs, size_t j, size_t n) const {
+        if (!open || j < at) {
+            return recs[j];
+        }
+        Rec rec = recs[j + len];
+        rec.offset = (uint32_t)(n - rec.offset);
+        return rec;
+    }
+    
+    // Put the gap before record j with room for at least 'room' records.
+    // Growing it adds an eighth of the records, so the occasional full move
+    // is paid for by many edits.
+    template <class Rec>
+    void move(vector<Rec>& recs, size_t j, size_t room, size_t n) {
+        if (!open) {
+            open = true;
+            at = recs.size();
+            len = 0;
+        }
+        if (len < room) {
+            size_t grow = max(room - len, recs.size() / 8 + 64);
+            recs.insert(recs.begin() + at + len, grow, Rec());
+            len += grow;
+        }
+        while (at > j) {
+            --at;
+            recs[at + len] = recs[at];
+            recs[at + len].offset = (uint32_t)(n - recs[at].offset);
+        }
+        while (at < j) {
+            recs[at] = recs[at + len];
+            recs[at].offset = (uint32_t)(n - recs[at + len].offset);
+            ++at;
+        }
+    }
+    
+    template <class Rec>
+    void close(vector<Rec>& recs, size_t n) {
+        if (!open) return;
+        move(recs, recs.size() - len, 0, n);
+        recs.resize(at);
+        open = false;
+    }
+    
+    // Index of the first record after the gap that starts at pos or later.
+    // Records the last edit began inside of can be further from the end
+    // than n, so the search compares distances, not offsets.
+    template <class Rec>
+    size_t firstAfterFrom(const vector<Rec>& recs, size_t pos, size_t n) const {
+        size_t lo = at + len, hi = recs.size();
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            if (recs[mid].offset > n - pos) lo = mid + 1; else hi = mid;
+        }
+        return lo - len;
+    }
+    
+    // Whether a record after the gap starts or ends at pos. Every token or
+    // error end is also the start of the next lexeme. Offsets are modulo
+    // 2^32 here, as in the old coordinates of such a record.
+    template <class Rec>
+    bool boundaryAfterAt(const vector<Rec>& recs, size_t pos, size_t n) const {
+        size_t j = firstAfterFrom(recs, pos, n);
+        if (j < count(recs) && get(recs, j, n).offset == pos) return true;
+        if (j == at) return false;
+        Rec prev = get(recs, j - 1, n);
+        return (uint32_t)(prev.offset + prev.length) == pos;
+    }
+};
+
+// ---------------------------------------------------------------------------
+// Scanner statistics
+//
+// Filled by LexicalAnalyzer when a LexStats is attached with setStats():
+// bytes and lexemes per scanner path, keyword lookups and hits, errors by
+// cause, result cache hits and misses and the wall time of each phase.
+// analyze() adds each lexeme to the counters of its AcceptKind after the DFA
+// has run, so the scan itself is untouched. Building with -DLEXER_NO_STATS
+// removes the layer; a LexStats then stays empty.
+// ---------------------------------------------------------------------------
+
+enum StatPhase {
+    PHASE_LOAD,
+    PHASE_ANALYZE,
+    PHASE_EXPORT,
+    NUM_STAT_PHASES
+};
+
+struct LexStats {
+    uint64_t bytes[NUM_ACCEPT_KINDS];       // by the AcceptKind of the lexeme
+    uint64_t lexemes[NUM_ACCEPT_KINDS];
+    uint64_t keywordHits;                   // ACC_WORD lexemes that were keywords
+    uint64_t cacheHits;                     // analyses answered by a ResultCache
+    uint64_t cacheMisses;
+    double seconds[NUM_STAT_PHASES];
+    uint64_t phaseRuns[NUM_STAT_PHASES];
+    
+    LexStats() { clear(); }
+    
+    void clear() {
+        memset(this, 0, sizeof(*this));
+    }
+    
+    void merge(const LexStats& other) {
+        for (int k = 0; k < NUM_ACCEPT_KINDS; ++k) {
+            bytes[k] += other.bytes[k];
+            lexemes[k] += other.lexemes[k];
+        }
+        keywordHits += other.keywordHits;
+        cacheHits += other.cacheHits;
+        cacheMisses += other.cacheMisses;
+        for (int ph = 0; ph < NUM_STAT_PHASES; ++ph) {
+            seconds[ph] += other.seconds[ph];
+            phaseRuns[ph] += other.phaseRuns[ph];
+        }
+    }
+    
+    // One lexeme as returned by scanLexeme()
+    void record(int kind, size_t len) {
+        bytes[kind] += len;
+        lexemes[kind]++;
+    }
+    
+    void print(ostream& out) const {
+        static const char* const phaseNames[NUM_STAT_PHASES] = { "load", "analyze", "export" };
+        uint64_t total = 0;
+        for (int k = 0; k < NUM_ACCEPT_KINDS; ++k) total += bytes[k];
+        out << "Scanner statistics (" << total << " bytes):\n";
+        printPath(out, "whitespace", bytes[ACC_SKIP], lexemes[ACC_SKIP], total);
+        printPath(out, "comments", bytes[ACC_COMMENT] + bytes[ACC_UNTERMINATED],
+                  lexemes[ACC_COMMENT] + lexemes[ACC_UNTERMINATED], total);
+        printPath(out, "identifiers", bytes[ACC_IDENT] + bytes[ACC_WORD],
+                  lexemes[ACC_IDENT] + lexemes[ACC_WORD], total);
+        printPath(out, "numbers", bytes[ACC_NUMBER] + bytes[ACC_BAD_NUMBER],
+                  lexemes[ACC_NUMBER] + lexemes[ACC_BAD_NUMBER], total);
+        printPath(out, "operators", bytes[ACC_OPERATOR] + bytes[ACC_BAD_OPERATOR],
+                  lexemes[ACC_OPERATOR] + lexemes[ACC_BAD_OPERATOR], total);
+        printPath(out, "punctuation", bytes[ACC_PUNCT], lexemes[ACC_PUNCT], total);
+        printPath(out, "other", bytes[ACC_ERROR], lexemes[ACC_ERROR], total);
+        out << "  keyword lookups: " << lexemes[ACC_WORD] << ", hits " << keywordHits << " ("
+            << (lexemes[ACC_WORD] ? 100.0 * keywordHits / lexemes[ACC_WORD] : 0.0) << "%)\n";
+        out << "  errors by cause: no underscore " << lexemes[ACC_WORD] - keywordHits
+            << ", malformed number " << lexemes[ACC_BAD_NUMBER]
+            << ", incomplete operator " << lexemes[ACC_BAD_OPERATOR]
+            << ", bad character " << lexemes[ACC_ERROR]
+            << ", unterminated comment " << lexemes[ACC_UNTERMINATED] << "\n";
+        if (cacheHits || cacheMisses) {
+            out << "  result cache: " << cacheHits << " hits, " << cacheMisses << " misses\n";
+        }
+        for (int ph = 0; ph < NUM_STAT_PHASES; ++ph) {
+            if (!phaseRuns[ph]) continue;
+            out << "  " << phaseNames[ph] << ": " << seconds[ph] << " s";
+            if (ph == PHASE_ANALYZE && seconds[ph] > 0 && total > 0) {
+                out << " (" << total / 1048576.0 / seconds[ph] << " MB/s)";
+            }
+            out << "\n";
+        }
+    }
+    
+    static void printPath(ostream& out, const char* name, uint64_t b, uint64_t n, uint64_t total) {
+        out << "  " << name << ": " << b << " bytes (" << (total ? 100.0 * b / total : 0.0)
+            << "%), " << n << " lexemes\n";
+    }
+};
+
+// Adds the lifetime of the object to one phase of a LexStats, if any
+class StatTimer {
+#ifndef LEXER_NO_STATS
+private:
+    LexStats* stats;
+    StatPhase phase;
+    chrono::steady_clock::time_point start;
+    
+public:
+    StatTimer(LexStats* s, StatPhase p): stats(s), phase(p) {
+        if (stats) start = chrono::steady_clock::now();
+    }
+    
+    ~StatTimer() {
+        if (!stats) return;
+        stats->seconds[phase] += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        stats->phaseRuns[phase]++;
+    }
+#else
+public:
+    StatTimer(LexStats*, StatPhase) {}
+#endif
+};
+
+// ---------------------------------------------------------------------------
+// Arena
+//
+// Bump allocator for the analyzer's variable-length data. Memory comes from
+// blocks that stay allocated when the arena is reset, so refilling it after
+// reset() makes no heap calls as long as the new contents fit in what the
+// previous run used. releaseMemory() hands the blocks back to the heap.
+// ---------------------------------------------------------------------------
+
+const size_t ARENA_BLOCK_SIZE = 64 * 1024;
+
+class Arena {
+private:
+    struct Block {
+        unique_ptr<char[]> data;
+        size_t size;
+    };
+    vector<Block> blocks;
+    size_t current;         // block being filled
+    size_t used;            // bytes taken from it
+    size_t reserved;        // total size of all blocks
+    
+public:
+    Arena(): current(0), used(0), reserved(0) {}
+    
+    char* allocate(size_t n) {
+        while (current < blocks.size() && used + n > blocks[current].size) {
+            current++;
+            used = 0;
+        }
+        if (current == blocks.size()) {
+            Block b;
+            b.size = max(ARENA_BLOCK_SIZE, n);
+            b.data.reset(new char[b.size]);
+            reserved += b.size;
+            blocks.push_back(move(b));
+            used = 0;
+        }
+        char* p = blocks[current].data.get() + used;
+        used += n;
+        return p;
+    }
+    
+    string_view copy(string_view text) {
+        char* dst = allocate(text.size());
+        memcpy(dst, text.data(), text.size());
+        return string_view(dst, text.size());
+    }
+    
+    // Forget everything allocated; the blocks are kept for reuse
+    void reset() {
+        current = 0;
+        used = 0;
+    }
+    
+    void releaseMemory() {
+        reset();
+        blocks.clear();
+        reserved = 0;
+    }
+    
+    size_t reservedBytes() const { return reserved; }
+};
+
+// ---------------------------------------------------------------------------
+// Symbol table
+//
+// Interns the text of identifier and number tokens: every distinct lexeme
+// gets a 32-bit id and an occurrence count, so later phases compare symbols
+// as integers. The text is copied once into an Arena, which keeps the names
+// valid after the source buffer is edited or replaced. Lookup is an
+// open-addressing hash table over the ids; a slot is in use only if it was
+// written in the current generation, so clear() does not touch the table.
+// ---------------------------------------------------------------------------
+
+class SymbolTable {
+private:
+    Arena text;
+    vector<string_view> names;
+    vector<uint32_t> hashes;
+    vector<uint32_t> counts;
+    vector<TokenType> types;
+    vector<uint32_t> slots;     // symbol id; power-of-two size
+    vector<uint32_t> slotGen;   // generation that wrote the slot
+    uint32_t generation;
+    bool slotsStale;            // filled by setBulk(), slots not built yet
+    
+    // Rebuild the slots for all symbols, with room for one more
+    void grow() {
+        size_t size = 1024;
+        while (size < (names.size() + 1) * 2) size *= 2;
+        vector<uint32_t> bigger(size);
+        vector<uint32_t> biggerGen(size, 0);
+        generation = 1;
+        size_t mask = size - 1;
+        for (size_t id = 0; id < names.size(); ++id) {
+            size_t k = hashes[id] & mask;
+            while (biggerGen[k] == generation) k = (k + 1) & mask;
+            bigger[k] = id;
+            biggerGen[k] = generation;
+        }
+        slots.swap(bigger);
+        slotGen.swap(biggerGen);
+        slotsStale = false;
+    }
+    
+public:
+    SymbolTable(): generation(1), slotsStale(false) {}
+    
+    static uint32_t hashOf(string_view lexeme) {
+        return (uint32_t)hash<string_view>()(lexeme);
+    }
+    
+    // Forget all symbols in O(1); the arena and the tables keep their
+    // capacity
+    void clear() {
+        text.reset();
+        names.clear();
+        hashes.clear();
+        counts.clear();
+        types.clear();
+        slotsStale = false;
+        if (++generation == 0) {
+            fill(slotGen.begin(), slotGen.end(), 0);
+            generation = 1;
+        }
+    }
+    
+    // clear() and give all memory back to the heap
+    void releaseMemory() {
+        clear();
+        vector<string_view>().swap(names);
+        vector<uint32_t>().swap(hashes);
+        vector<uint32_t>().swap(counts);
+        vector<TokenType>().swap(types);
+        vector<uint32_t>().swap(slots);
+        vector<uint32_t>().swap(slotGen);
+        text.releaseMemory();
+    }
+    
+    size_t memoryBytes() const {
+        return text.reservedBytes()
+            + names.capacity() * sizeof(string_view)
+            + (hashes.capacity() + counts.capacity() + slots.capacity() + slotGen.capacity()) * sizeof(uint32_t)
+            + types.capacity() * sizeof(TokenType);
+    }
+    
+    // Id of text, adding it if new; counts one occurrence
+    uint32_t intern(string_view lexeme, TokenType type) {
+        return intern(lexeme, hashOf(lexeme), type, 1);
+    }
+    
+    // The same with the hash already known (h == hashOf(lexeme)), counting
+    // 'occurrences' occurrences
+    uint32_t intern(string_view lexeme, uint32_t h, TokenType type, uint32_t occurrences) {
+        if (slotsStale || (names.size() + 1) * 2 > slots.size()) {
+            grow();
+        }
+        size_t mask = slots.size() - 1;
+        size_t k = h & mask;
+        while (slotGen[k] == generation) {
+            uint32_t id = slots[k];
+            if (hashes[id] == h && names[id] == lexeme) {
+                counts[id] += occurrences;
+                return id;
+            }
+            k = (k + 1) & mask;
+        }
+        uint32_t id = names.size();
+        slots[k] = id;
+        slotGen[k] = generation;
+        names.push_back(text.copy(lexeme));
+        hashes.push_back(h);
+        counts.push_back(occurrences);
+        types.push_back(type);
+        return id;
+    }
+    
+    // Replace the contents with 'count' symbols that the caller fills in
+    // with setBulk(), from several threads if it likes; returns storage
+    // for textBytes of names. Lookups rebuild the slots first.
+    char* resizeBulk(size_t count, size_t textBytes) {
+        clear();
+        names.resize(count);
+        hashes.resize(count);
+        counts.resize(count);
+        types.resize(count);
+        slotsStale = true;
+        return text.allocate(textBytes);
+    }
+    
+    void setBulk(uint32_t id, string_view name, uint32_t h, TokenType type, uint32_t count) {
+        names[id] = name;
+        hashes[id] = h;
+        counts[id] = count;
+        types[id] = type;
+    }
+    
+    // Drop one occurrence (the token was re-lexed away by an edit)
+    void release(uint32_t id) {
+        if (id < counts.size() && counts[id] > 0) {
+            counts[id]--;
+        }
+    }
+    
+    size_t size() const { return names.size(); }
+    string_view name(uint32_t id) const { return names[id]; }
+    uint32_t hashOf(uint32_t id) const { return hashes[id]; }
+    uint32_t count(uint32_t id) const { return counts[id]; }
+    TokenType type(uint32_t id) const { return types[id]; }
+    
+    // Ids of the symbols of one type, most frequent first
+    vector<uint32_t> mostFrequent(TokenType type, size_t limit) const {
+        vector<uint32_t> ids;
+        for (uint32_t id = 0; id < names.size(); ++id) {
+            if (types[id] == type && counts[id] > 0) ids.push_back(id);
+        }
+        size_t n = min(limit, ids.size());
+        partial_sort(ids.begin(), ids.begin() + n, ids.end(), [this](uint32_t a, uint32_t b) {
+            return counts[a] != counts[b] ? counts[a] > counts[b] : names[a] < names[b];
+        });
+        ids.resize(n);
+        return ids;
+    }
+};
+
+// Output of one worker in analyzeParallel(): the tokens and errors of a chunk
+// lexed speculatively from the start state, plus the start of every lexeme
+// (skipped whitespace and comments included) so the merge can find where the
+// true token stream falls into step with it. Records from tokenFrom and
+// errorFrom on are part of the result; with interning on, their symbols are
+// first numbered in the chunk's own table.
+struct ChunkResult {
+    vector<Token> tokens;
+    vector<LexError> errors;
+    vector<uint32_t> boundaries;
+    size_t end;                 // end of the last lexeme scanned
+    size_t tokenFrom;
+    size_t errorFrom;
+    size_t tokenBase;           // index of tokens[tokenFrom] in the result
+    SymbolTable symbols;
+    vector<uint32_t> remap;     // local symbol id -> shard id -> final id
+    size_t newSymbols;          // symbols seen in no earlier chunk
+    size_t typeCounts[NUM_TOKEN_TYPES];
+    
+    ChunkResult(): end(0), tokenFrom(0), errorFrom(0), tokenBase(0), newSymbols(0) {}
+    
+    size_t memoryBytes() const {
+        return tokens.capacity() * sizeof(Token) + errors.capacity() * sizeof(LexError)
+            + (boundaries.capacity() + remap.capacity()) * sizeof(uint32_t) + symbols.memoryBytes();
+    }
+    
+    void addToken(TokenType type, uint32_t start, uint32_t len) {
+        Token tok;
+        tok.type = type;
+        tok.offset = start;
+        tok.length = len;
+        tok.symbol = NO_SYMBOL;
+        tokens.push_back(tok);
+    }
+    
+    void addError(ErrorKind kind, uint32_t start, uint32_t len) {
+        LexError err;
+        err.kind = kind;
+        err.offset = start;
+        err.length = len;
+        errors.push_back(err);
+    }
+};
+
+// One hash partition of the symbols of all chunks in analyzeParallel(): each
+// distinct lexeme once, with the chunk that has it first
+struct SymbolShard {
+    SymbolTable table;
+    vector<uint32_t> owner;     // chunk of the first occurrence
+    vector<uint32_t> finalId;
+    size_t textBytes;
+    size_t textBase;
+    
+    SymbolShard(): textBytes(0), textBase(0) {}
+    
+    size_t memoryBytes() const {
+        return table.memoryBytes() + (owner.capacity() + finalId.capacity()) * sizeof(uint32_t);
+    }
+    
+    static size_t of(uint32_t h, size_t shards) {
+        return (size_t)(((uint64_t)h * shards) >> 32);
+    }
+};
+
+// ---------------------------------------------------------------------------
+// Source buffer
+//
+// The text being analyzed. A regular file is mapped read-only and scanned in
+// place, so loading costs little more than the page-ins; the mapping is
+// file-backed, so inputs larger than RAM are paged through as the scanner
+// moves along. Pipes, stdin ("-") and manually entered code are kept in an
+// owned string filled with large block reads.
+// ---------------------------------------------------------------------------
+
+// Offsets in Token/LexError are 32-bit
+const size_t MAX_SOURCE_SIZE = 0xFFFFFFFFu;
+const size_t READ_BLOCK_SIZE = 1 << 20;
+const size_t STREAM_BLOCK_SIZE = 64 << 10;     // default for analyzeStream()
+
+class SourceBuffer {
+private:
+    // Owned text may have a gap of gapLen unused bytes at gapStart, left by
+    // replace() so that edits close together only move the bytes between
+    // them. Reading through data() or view() closes it.
+    mutable string owned;
+    mutable size_t gapStart;
+    mutable size_t gapLen;
+    const char* mapped;
+    size_t mappedSize;
+    mutable vector<uint32_t> lineStarts;    // built by locate() on first use
+    mutable bool linesIndexed;
+    
+    SourceBuffer(const SourceBuffer&);
+    SourceBuffer& operator=(const SourceBuffer&);
+    
+    void release() {
+#ifdef LEXER_HAVE_MMAP
+        if (mapped) {
+            munmap((void*)mapped, mappedSize);
+        }
+#endif
+        mapped = NULL;
+        mappedSize = 0;
+        owned.clear();
+        gapStart = 0;
+        gapLen = 0;
+        linesIndexed = false;
+    }
+    
+    void closeGap() const {
+        if (gapLen == 0) return;
+        memmove(&owned[gapStart], &owned[gapStart + gapLen], owned.size() - gapStart - gapLen);
+        owned.resize(owned.size() - gapLen);
+        gapLen = 0;
+    }
+    
+    // Put the gap at 'at' with room for at least 'room' bytes. Growing it
+    // adds an eighth of the text, so the occasional full move is paid for
+    // by many edits.
+    void moveGap(size_t at, size_t room) {
+        if (gapLen == 0) {
+            gapStart = at;
+        }
+        if (gapLen < room) {
+            size_t grow = max(room - gapLen, owned.size() / 8 + 4096);
+            owned.insert(gapStart + gapLen, grow, '\0');
+            gapLen += grow;
+        }
+        if (at < gapStart) {
+            memmove(&owned[at + gapLen], &owned[at], gapStart - at);
+        } else if (at > gapStart) {
+            memmove(&owned[gapStart], &owned[gapStart + gapLen], at - gapStart);
+        }
+        gapStart = at;
+    }
+    
+    void indexLines() const {
+        const char* p = data();
+        size_t n = size();
+        lineStarts.assign(1, 0);
+        for (const char* nl = (const char*)memchr(p, '\n', n); nl; ) {
+            size_t next = nl - p + 1;
+            lineStarts.push_back(next);
+            nl = (const char*)memchr(p + next, '\n', n - next);
+        }
+        linesIndexed = true;
+    }
+    
+#ifdef LEXER_HAVE_MMAP
+    // Read everything from a descriptor that cannot be mapped
+    bool readAll(int fd) {
+        vector<char> block(READ_BLOCK_SIZE);
+        while (true) {
+            ssize_t got = read(fd, block.data(), block.size());
+            if (got < 0) {
+                return false;
+            }
+            if (got == 0) {
+                return true;
+            }
+            if (owned.size() + got > MAX_SOURCE_SIZE) {
+                return false;
+            }
+            owned.append(block.data(), got);
+        }
+    }
+#endif
+    
+public:
+    SourceBuffer(): gapStart(0), gapLen(0), mapped(NULL), mappedSize(0), linesIndexed(false) {}
+    ~SourceBuffer() { release(); }
+    
+    void assign(const string& src) {
+        release();
+        owned = src;
+    }
+    
+    // Load a whole file; "-" reads standard input
+    bool loadFile(const string& filename) {
+        release();
+#ifdef LEXER_HAVE_MMAP
+        int fd = (filename == "-") ? dup(STDIN_FILENO) : open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        bool ok = fstat(fd, &st) == 0;
+        if (ok && S_ISREG(st.st_mode) && st.st_size > 0) {
+            if ((size_t)st.st_size > MAX_SOURCE_SIZE) {
+                close(fd);
+                return false;
+            }
+            void* p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                madvise(p, st.st_size, MADV_SEQUENTIAL);
+                mapped = (const char*)p;
+                mappedSize = st.st_size;
+            } else {
+                ok = readAll(fd);
+            }
+        } else if (ok) {
+            ok = readAll(fd);
+        }
+        close(fd);
+        if (!ok) {
+            release();
+        }
+        return ok;
+#else
+        ifstream fin(filename.c_str(), ios::binary);
+        if (!fin) {
+            return false;
+        }
+        fin.seekg(0, ios::end);
+        streamoff size = fin.tellg();
+        fin.seekg(0, ios::beg);
+        if (size < 0 || (size_t)size > MAX_SOURCE_SIZE) {
+            return false;
+        }
+        owned.resize((size_t)size);
+        fin.read(&owned[0], size);
+        return (bool)fin || fin.eof();
+#endif
+    }
+    
+    // Replace removedLen bytes at offset. A mapped file is copied into the
+    // owned string on the first edit; after that an edit moves only the
+    // bytes between it and the previous one.
+    void replace(size_t offset, size_t removedLen, string_view inserted) {
+        if (mapped) {
+            string copy(mapped, mappedSize);
+            release();
+            owned.swap(copy);
+        }
+        moveGap(offset, inserted.size() > removedLen ? inserted.size() - removedLen : 0);
+        gapLen += removedLen;
+        memcpy(&owned[gapStart], inserted.data(), inserted.size());
+        gapStart += inserted.size();
+        gapLen -= inserted.size();
+        linesIndexed = false;
+    }
+    
+    // 1-based line and byte column of offset. The line start index is built
+    // once for the current contents, on the first call.
+    void locate(size_t offset, uint32_t& line, uint32_t& column) const {
+        if (!linesIndexed) {
+            indexLines();
+        }
+        size_t k = upper_bound(lineStarts.begin(), lineStarts.end(), (uint32_t)offset) - lineStarts.begin();
+        line = (uint32_t)k;
+        column = (uint32_t)(offset - lineStarts[k - 1] + 1);
+    }
+    
+    // Text from pos on without closing the gap: p[i] is byte i of the text
+    // for pos <= i < size(). Moves the gap to pos.
+    const char* suffixFrom(size_t pos) {
+        if (mapped || gapLen == 0) {
+            return data();
+        }
+        moveGap(pos, 0);
+        return owned.data() + gapLen;
+    }
+    
+    // len bytes at offset, clipped to the text. Only a slice across the gap
+    // closes it.
+    string_view slice(size_t offset, size_t len) const {
+        size_t n = size();
+        offset = min(offset, n);
+        len = min(len, n - offset);
+        if (mapped) {
+            return string_view(mapped + offset, len);
+        }
+        if (gapLen != 0 && offset >= gapStart) {
+            return string_view(owned.data() + offset + gapLen, len);
+        }
+        if (gapLen != 0 && offset + len > gapStart) {
+            closeGap();
+        }
+        return string_view(owned.data() + offset, len);
+    }
+    
+    const char* data() const {
+        if (mapped) return mapped;
+        closeGap();
+        return owned.data();
+    }
+    
+    size_t size() const { return mapped ? mappedSize : owned.size() - gapLen; }
+    string_view view() const { return string_view(data(), size()); }
+};
+
+// ---------------------------------------------------------------------------
+// Binary token file
+//
+// A compact alternative to Token.txt/Error.txt for later compiler phases:
+//
+//   header (56 bytes, little-endian)
+//     0  "LXTK"               magic
+//     4  u16 version
+//     6  u16 flags            TOKFILE_LEXEMES: lexeme table present
+//     8  u64 source size
+//    16  u64 token count
+//    24  u64 error count
+//    32  u64 offset of the error section
+//    40  u64 offset of the lexeme table (0 if none)
+//    48  u64 lexeme count
+//   tokens, from byte 56, one record each:
+//     varint type, varint gap (offset - end of previous token), varint length
+//     [varint lexeme id]
+//   errors: same record layout with the ErrorKind instead of the type
+//   lexeme table: varint length + bytes per distinct lexeme
+//
+// Varints are LEB128. The lexeme table interns every distinct token and error
+// text so a reader does not need the source file.
+// ---------------------------------------------------------------------------
+
+const char TOKFILE_MAGIC[4] = { 'L', 'X', 'T', 'K' };
+const uint16_t TOKFILE_VERSION = 1;
+const uint16_t TOKFILE_LEXEMES = 1;
+const size_t TOKFILE_HEADER_SIZE = 56;
+const size_t TOKFILE_WRITE_BLOCK = 1 << 20;
+
+inline void putVarint(string& out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back((char)(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((char)v);
+}
+
+// Returns false on a truncated or overlong varint
+inline bool getVarint(const unsigned char*& p, const unsigned char* end, uint64_t& v) {
+    v = 0;
+    for (int shift = 0; shift < 64 && p < end; shift += 7) {
+        unsigned char b = *p++;
+        v |= (uint64_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) return true;
+    }
+    return false;
+}
+
+inline void putU64(char* out, uint64_t v) {
+    for (int k = 0; k < 8; ++k) out[k] = (char)(v >> (8 * k));
+}
+
+inline uint64_t getU64(const unsigned char* p) {
+    uint64_t v = 0;
+    for (int k = 0; k < 8; ++k) v |= (uint64_t)p[k] << (8 * k);
+    return v;
+}
+
+// Ids of the distinct lexemes of a token file, in order of first use. Open
+// addressing; a slot holds the hash next to the id, so a probe that misses
+// reads only the slot, and growing the table never hashes again.
+class LexemeIndex {
+private:
+    struct Slot {
+        uint32_t hash;
+        uint32_t id;        // id + 1, 0 when free
+    };
+    
+    vector<string_view> texts;
+    vector<Slot> slots;     // power-of-two size
+    
+    void rehash(size_t size) {
+        vector<Slot> bigger(size, Slot());
+        size_t mask = size - 1;
+        for (size_t k = 0; k < slots.size(); ++k) {
+            if (slots[k].id == 0) continue;
+            size_t j = slots[k].hash & mask;
+            while (bigger[j].id != 0) j = (j + 1) & mask;
+            bigger[j] = slots[k];
+        }
+        slots.swap(bigger);
+    }
+    
+public:
+    LexemeIndex() { rehash(1024); }
+    
+    // Room for 'count' lexemes without growing
+    void reserve(size_t count) {
+        texts.reserve(count);
+        size_t size = slots.size();
+        while (size < count * 2) size *= 2;
+        if (size > slots.size()) rehash(size);
+    }
+    
+    uint32_t intern(string_view text) {
+        if ((texts.size() + 1) * 2 > slots.size()) {
+            rehash(slots.size() * 2);
+        }
+        uint32_t h = (uint32_t)hash<string_view>()(text);
+        size_t mask = slots.size() - 1;
+        size_t k = h & mask;
+        for (; slots[k].id != 0; k = (k + 1) & mask) {
+            if (slots[k].hash == h && texts[slots[k].id - 1] == text) return slots[k].id - 1;
+        }
+        texts.push_back(text);
+        slots[k].hash = h;
+        slots[k].id = texts.size();
+        return texts.size() - 1;
+    }
+    
+    size_t size() const { return texts.size(); }
+    string_view text(uint32_t id) const { return texts[id]; }
+};
+
+// ---------------------------------------------------------------------------
+// Content hash
+//
+// XXH64 (xxHash, 64-bit variant) of a byte range: four independent lanes
+// over 32-byte stripes, so hashing runs at memory speed. Reads are
+// native-endian, which matches the reference on little-endian machines.
+// ---------------------------------------------------------------------------
+
+const uint64_t XXH_PRIME1 = 0x9E3779B185EBCA87ull;
+const uint64_t XXH_PRIME2 = 0xC2B2AE3D27D4EB4Full;
+const uint64_t XXH_PRIME3 = 0x165667B19E3779F9ull;
+const uint64_t XXH_PRIME4 = 0x85EBCA77C2B2AE63ull;
+const uint64_t XXH_PRIME5 = 0x27D4EB2F165667C5ull;
+
+inline uint64_t rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+inline uint64_t xxhRound(uint64_t acc, uint64_t input) {
+    acc += input * XXH_PRIME2;
+    return rotl64(acc, 31) * XXH_PRIME1;
+}
+
+inline uint64_t xxhMerge(uint64_t acc, uint64_t lane) {
+    acc ^= xxhRound(0, lane);
+    return acc * XXH_PRIME1 + XXH_PRIME4;
+}
+
+uint64_t contentHash(const void* data, size_t len, uint64_t seed) {
+    const unsigned char* p = (const unsigned char*)data;
+    const unsigned char* end = p + len;
+    uint64_t h;
+    uint64_t word;
+    uint32_t half;
+    if (len >= 32) {
+        uint64_t v1 = seed + XXH_PRIME1 + XXH_PRIME2;
+        uint64_t v2 = seed + XXH_PRIME2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - XXH_PRIME1;
+        for (; p + 32 <= end; p += 32) {
+            memcpy(&word, p, 8);
+            v1 = xxhRound(v1, word);
+            memcpy(&word, p + 8, 8);
+            v2 = xxhRound(v2, word);
+            memcpy(&word, p + 16, 8);
+            v3 = xxhRound(v3, word);
+            memcpy(&word, p + 24, 8);
+            v4 = xxhRound(v4, word);
+        }
+        h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+        h = xxhMerge(h, v1);
+        h = xxhMerge(h, v2);
+        h = xxhMerge(h, v3);
+        h = xxhMerge(h, v4);
+    } else {
+        h = seed + XXH_PRIME5;
+    }
+    h += len;
+    for (; p + 8 <= end; p += 8) {
+        memcpy(&word, p, 8);
+        h ^= xxhRound(0, word);
+        h = rotl64(h, 27) * XXH_PRIME1 + XXH_PRIME4;
+    }
+    if (p + 4 <= end) {
+        memcpy(&half, p, 4);
+        h ^= half * XXH_PRIME1;
+        h = rotl64(h, 23) * XXH_PRIME2 + XXH_PRIME3;
+        p += 4;
+    }
+    for (; p < end; ++p) {
+        h ^= *p * XXH_PRIME5;
+        h = rotl64(h, 11) * XXH_PRIME1;
+    }
+    h ^= h >> 33;
+    h *= XXH_PRIME2;
+    h ^= h >> 29;
+    h *= XXH_PRIME3;
+    h ^= h >> 32;
+    return h;
+}
+
+// ---------------------------------------------------------------------------
+// Result cache
+//
+// Keeps the results of analyze() on disk so that unchanged inputs are not
+// lexed again by later runs. The key is the content hash of the source,
+// seeded with a fingerprint of everything else that decides the results:
+// LEX_SPEC_FINGERPRINT, CACHE_VERSION and the error policy. One entry per
+// file, named after its key:
+//
+//   header (104 bytes)
+//     0  "LXRC"               magic
+//     4  u32 version
+//     8  u64 fingerprint
+//    16  u64 content hash
+//    24  u64 source size
+//    32  u64 token count
+//    40  u64 error count
+//    48  u64 symbol count
+//    56  u64 token count per TokenType, 6 of them (index 0 unused)
+//   tokens: Token records
+//   errors: LexError records
+//   symbols: CacheSymbol records
+//
+// Everything is in the analyzer's own memory layout and byte order, which
+// the fingerprint covers, with padding zeroed. The entry is mapped and the
+// tokens and errors are copied into the analyzer in one block each; lexemes
+// come from the source as usual. The symbol records are kept and the symbol
+// table is only built from them when it is first used. Only the header is
+// trusted to match; records pointing outside the source make the entry a
+// miss.
+//
+// Entries are written to a temporary file and renamed into place, so a
+// reader never sees a partial one, and a mapping stays valid if the entry is
+// deleted meanwhile. The total size is kept in the "size" file, read and
+// written under an exclusive flock() on the "lock" file; an entry replaced
+// by a concurrent store of the same key is counted twice until the next
+// trim recounts. When a store takes the total over the limit, the least
+// recently used entries (a hit sets the modification time) are deleted
+// until the cache is back at 90% of it.
+// ---------------------------------------------------------------------------
+
+const char CACHE_MAGIC[4] = { 'L', 'X', 'R', 'C' };
+const uint32_t CACHE_VERSION = 2;              // bump when main.cpp changes what analyze() produces
+const uint64_t CACHE_DEFAULT_LIMIT = 1ull << 30;
+const char* const CACHE_ENTRY_SUFFIX = ".lxrc";
+
+struct CacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t fingerprint;
+    uint64_t contentHash;
+    uint64_t sourceSize;
+    uint64_t tokenCount;
+    uint64_t errorCount;
+    uint64_t symbolCount;
+    uint64_t typeCounts[NUM_TOKEN_TYPES];
+};
+
+// A symbol of a cache entry: its first occurrence in the source, its count
+// and SymbolTable::hashOf() of the name
+struct CacheSymbol {
+    TokenType type;
+    uint32_t offset;
+    uint32_t length;
+    uint32_t count;
+    uint32_t hash;
+};
+
+// Ask for huge pages for a large buffer about to be filled, so that the
+// first touch takes one page fault per 2 MB instead of per 4 KB
+inline void adviseHugePages(void* p, size_t bytes) {
+#if defined(LEXER_HAVE_MMAP) && defined(MADV_HUGEPAGE)
+    uintptr_t first = ((uintptr_t)p + 4095) & ~(uintptr_t)4095;
+    uintptr_t end = ((uintptr_t)p + bytes) & ~(uintptr_t)4095;
+    if (end > first + (2 << 20)) {
+        madvise((void*)first, end - first, MADV_HUGEPAGE);
+    }
+#else
+    (void)p;
+    (void)bytes;
+#endif
+}
+
+inline size_t cacheEntrySize(size_t nTokens, size_t nErrors, size_t nSymbols) {
+    return sizeof(CacheHeader) + nTokens * sizeof(Token) + nErrors * sizeof(LexError)
+        + nSymbols * sizeof(CacheSymbol);
+}
+
+// A cache directory, shared by any number of analyzers, threads and
+// processes. Only moves entries between disk and memory; LexicalAnalyzer
+// encodes and decodes them (see setCache()).
+class ResultCache {
+private:
+    string dir;
+    uint64_t limit;
+    uint64_t nonce;                 // makes temporary names unique per process
+    mutable atomic<uint64_t> tempCount;
+    
+    ResultCache(const ResultCache&);
+    ResultCache& operator=(const ResultCache&);
+    
+    // Exclusive lock on the cache directory for the lifetime of the object.
+    // Without flock() concurrent trims are not serialized; entries are still
+    // never seen half-written.
+    class DirLock {
+    private:
+        int fd;
+        
+    public:
+        explicit DirLock(const string& path): fd(-1) {
+#ifdef LEXER_HAVE_MMAP
+            fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+            if (fd >= 0 && flock(fd, LOCK_EX) != 0) {
+                close(fd);
+                fd = -1;
+            }
+#else
+            (void)path;
+#endif
+        }
+        
+        ~DirLock() {
+#ifdef LEXER_HAVE_MMAP
+            if (fd >= 0) {
+                flock(fd, LOCK_UN);
+                close(fd);
+            }
+#endif
+        }
+    };
+    
+    string entryPath(uint64_t key) const {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx", (unsigned long long)key);
+        return dir + "/" + name + CACHE_ENTRY_SUFFIX;
+    }
+    
+    // Delete entries, least recently used first, until at most 'target'
+    // bytes are left; also removes temporary files that a crashed store left
+    // behind. Returns the size that is left. Called with the lock held.
+    uint64_t trim(uint64_t target) const {
+        struct Entry {
+            filesystem::file_time_type used;
+            uint64_t size;
+            filesystem::path path;
+        };
+        vector<Entry> entries;
+        uint64_t total = 0;
+        filesystem::file_time_type staleBefore = filesystem::file_time_type::clock::now() - chrono::hours(1);
+        error_code ec;
+        for (filesystem::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+            Entry e;
+            e.path = it->path();
+            string name = e.path.filename().string();
+            e.used = filesystem::last_write_time(e.path, ec);
+            e.size = filesystem::file_size(e.path, ec);
+            if (ec) {
+                ec.clear();
+                continue;
+            }
+            if (name.find(".tmp") != string::npos) {
+                if (e.used < staleBefore) filesystem::remove(e.path, ec);
+                ec.clear();
+            } else if (e.path.extension() == CACHE_ENTRY_SUFFIX) {
+                entries.push_back(e);
+                total += e.size;
+            }
+        }
+        sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+            return a.used < b.used;
+        });
+        for (size_t k = 0; k < entries.size() && total > target; ++k) {
+            if (filesystem::remove(entries[k].path, ec)) {
+                total -= entries[k].size;
+            }
+        }
+        return total;
+    }
+    
+    // Add a new entry's size to the total and trim when over the limit
+    void account(uint64_t added) const {
+        DirLock lock(dir + "/lock");
+        string sizePath = dir + "/size";
+        uint64_t total = 0;
+        {
+            ifstream in(sizePath.c_str());
+            in >> total;
+        }
+        total += added;
+        if (total > limit) {
+            total = trim(limit / 10 * 9);
+        }
+        ofstream out(sizePath.c_str(), ios::trunc);
+        out << total << "\n";
+    }
+    
+public:
+    ResultCache(): limit(CACHE_DEFAULT_LIMIT), nonce(random_device()()), tempCount(0) {}
+    
+    // Use (and create) the directory; maxBytes caps the total entry size
+    bool open(const string& directory, uint64_t maxBytes = CACHE_DEFAULT_LIMIT) {
+        error_code ec;
+        filesystem::create_directories(directory, ec);
+        if (!filesystem::is_directory(directory, ec)) {
+            return false;
+        }
+        dir = directory;
+        limit = maxBytes;
+        return true;
+    }
+    
+    // Map the entry stored under key into entry and mark it as used
+    bool lookup(uint64_t key, SourceBuffer& entry) const {
+        string path = entryPath(key);
+        if (!entry.loadFile(path)) {
+            return false;
+        }
+        error_code ec;
+        filesystem::last_write_time(path, filesystem::file_time_type::clock::now(), ec);
+        return true;
+    }
+    
+    // Write an entry; a concurrent store of the same key just replaces it
+    bool store(uint64_t key, const string& bytes) const {
+        string path = entryPath(key);
+        string temp = path + ".tmp" + to_string(nonce) + "-" + to_string(tempCount++);
+        ofstream out(temp.c_str(), ios::binary);
+        out.write(bytes.data(), bytes.size());
+        out.close();
+        error_code ec;
+        if (!out.fail()) {
+            filesystem::rename(temp, path, ec);
+        }
+        if (out.fail() || ec) {
+            filesystem::remove(temp, ec);
+            return false;
+        }
+        account(bytes.size());
+        return true;
+    }
+};
+
+class LexicalAnalyzer {
+private:
+    SourceBuffer sourceCode;
+    vector<Token> tokens;
+    vector<LexError> errors;
+    TokenSink* sink;        // when set, results are streamed instead of stored
+    bool resultsCurrent;    // tokens/errors describe sourceCode (needed by applyEdit)
+    RecordGap tokenGap;     // left by applyEdit(), closed by settleRecords()
+    RecordGap errorGap;
+    
+    // Per-type view of the tokens: counts are always kept current, the
+    // index lists (positions in tokens, by type) are filled by analyze()
+    // and rebuilt on first use after analyzeParallel() or applyEdit()
+    size_t typeCounts[NUM_TOKEN_TYPES];
+    vector<uint32_t> typeIndex[NUM_TOKEN_TYPES];
+    bool typeIndexStale;
+    
+    // Identifiers and numbers, see setSymbolInterning. After a cache hit
+    // the table is built from pendingSymbols on first use.
+    mutable SymbolTable symbols;
+    mutable vector<CacheSymbol> pendingSymbols;
+    bool internSymbols;
+    vector<ChunkResult> chunkResults;   // analyzeParallel() buffers, kept for reuse
+    vector<SymbolShard> symbolShards;
+    LexStats* stats;        // optional profiling counters (see setStats)
+    const ResultCache* cache;   // optional, see setCache
+    size_t memoryLimit;     // result storage kept between runs (see setMemoryLimit)
+    RecoveryMode recovery;
+    size_t maxErrors;       // 0 = no cutoff
+    size_t errorsSeen;      // errors of this analyze() run, streamed ones included
+    bool errorPositions;    // see setErrorPositions
+    
+    static bool isKeyword(string_view str) {
+        return lookupKeyword(str);
+    }
+    
+    void addToken(TokenType type, uint32_t start, uint32_t len) {
+        Token tok;
+        tok.type = type;
+        tok.offset = start;
+        tok.length = len;
+        tok.symbol = sink ? NO_SYMBOL : symbolFor(type, start, len);
+        typeCounts[type]++;
+        if (sink) {
+            sink->onToken(tok, lexeme(tok));
+            return;
+        }
+        typeIndex[type].push_back(tokens.size());
+        tokens.push_back(tok);
+    }
+    
+    uint32_t symbolFor(TokenType type, uint32_t start, uint32_t len) {
+        if (!internSymbols || (type != TOK_IDENTIFIER && type != TOK_NUMBER)) {
+            return NO_SYMBOL;
+        }
+        return symbols.intern(sourceCode.slice(start, len), type);
+    }
+    
+    void resetTypeIndex() {
+        for (int t = 0; t < NUM_TOKEN_TYPES; ++t) {
+            typeCounts[t] = 0;
+            typeIndex[t].clear();
+        }
+        typeIndexStale = false;
+    }
+    
+    // Empty the results for a new run without freeing anything, so a
+    // re-analysis of similar input makes no heap calls. Storage that has
+    // grown past memoryLimit is given back first.
+    void resetResults() {
+        if (memoryBytes() > memoryLimit) {
+            releaseParallelBuffers();
+            vector<Token>().swap(tokens);
+            vector<LexError>().swap(errors);
+            for (int t = 0; t < NUM_TOKEN_TYPES; ++t) {
+                vector<uint32_t>().swap(typeIndex[t]);
+            }
+            symbols.releaseMemory();
+            vector<CacheSymbol>().swap(pendingSymbols);
+        }
+        tokens.clear();
+        errors.clear();
+        tokenGap = RecordGap();
+        errorGap = RecordGap();
+        resetTypeIndex();
+        symbols.clear();
+        pendingSymbols.clear();
+        errorsSeen = 0;
+    }
+    
+    bool errorPolicyActive() const {
+        return recovery != RECOVER_NONE || maxErrors != 0;
+    }
+    
+    // Whether emitToken() will turn this lexeme into an error
+    static bool lexemeIsError(const char* src, int kind, size_t start, size_t end) {
+        switch (kind) {
+            case ACC_SKIP:
+            case ACC_COMMENT:
+            case ACC_IDENT:
+            case ACC_NUMBER:
+            case ACC_OPERATOR:
+            case ACC_PUNCT:
+                return false;
+            case ACC_WORD:
+                return !isKeyword(string_view(src + start, end - start));
+            default:
+                return true;
+        }
+    }
+    
+    // End of an error under RECOVER_SKIP_TO_DELIMITER: the rest of the
+    // malformed text up to whitespace or a separator is swallowed with it,
+    // and an unterminated comment only takes the rest of its line instead
+    // of the whole remaining input
+    static size_t recoveryEnd(const char* src, int kind, size_t start, size_t end, size_t n) {
+        if (kind == ACC_UNTERMINATED) {
+            const char* nl = (const char*)memchr(src + start, '\n', n - start);
+            return nl ? (size_t)(nl - src) : n;
+        }
+        while (end < n && !isWhitespaceByte(src[end]) && !strchr(";,(){}[]", src[end])) {
+            end++;
+        }
+        return end;
+    }
+    
+    void releaseParallelBuffers() {
+        vector<ChunkResult>().swap(chunkResults);
+        vector<SymbolShard>().swap(symbolShards);
+    }
+    
+    void ensureTypeIndex() {
+        if (!typeIndexStale) return;
+        settleRecords();
+        resetTypeIndex();
+        for (size_t j = 0; j < tokens.size(); ++j) {
+            typeCounts[tokens[j].type]++;
+            typeIndex[tokens[j].type].push_back(j);
+        }
+    }
+    
+    void addError(ErrorKind kind, uint32_t start, uint32_t len) {
+        LexError err;
+        err.kind = kind;
+        err.offset = start;
+        err.length = len;
+        errorsSeen++;
+        if (sink) {
+            sink->onError(err, errorText(err));
+            return;
+        }
+        errors.push_back(err);
+    }
+    
+    // Turn the accepting state the DFA stopped in into a token or error.
+    // Out is the analyzer itself or a ChunkResult of a parallel worker.
+    template <class Out>
+    static void emitToken(Out& out, const char* src, int kind, uint32_t start, uint32_t len) {
+        switch (kind) {
+            case ACC_SKIP:
+            case ACC_COMMENT:
+                break;
+            case ACC_WORD:
+                // keywords never contain '_', so only these need the lookup
+                if (isKeyword(string_view(src + start, len))) {
+                    out.addToken(TOK_KEYWORD, start, len);
+                } else {
+                    out.addError(ERR_NO_UNDERSCORE, start, len);
+                }
+                break;
+            case ACC_IDENT:
+                out.addToken(TOK_IDENTIFIER, start, len);
+                break;
+            case ACC_NUMBER:
+                out.addToken(TOK_NUMBER, start, len);
+                break;
+            case ACC_OPERATOR:
+                out.addToken(TOK_OPERATOR, start, len);
+                break;
+            case ACC_PUNCT:
+                out.addToken(TOK_PUNCTUATION, start, len);
+                break;
+            case ACC_BAD_NUMBER:
+                out.addError(ERR_MALFORMED_NUMBER, start, len);
+                break;
+            case ACC_BAD_OPERATOR:
+                out.addError(ERR_INCOMPLETE_OPERATOR, start, len);
+                break;
+            case ACC_UNTERMINATED:
+                out.addError(ERR_UNTERMINATED_COMMENT, start, len);
+                break;
+            default:
+                out.addError(ERR_BAD_CHARACTER, start, len);
+                break;
+        }
+    }
+    
+    struct NoStats {
+        void record(int, size_t) {}
+    };
+    
+    // Scan the lexeme at i, hand its token or error to out and return where
+    // the next lexeme starts, or n when the max-errors cutoff ends the scan.
+    // Out is the analyzer or a TokenStream; guarded is errorPolicyActive().
+    template <class Out, class Counter>
+    size_t scanStep(Out& out, Counter& counter, const char* src, size_t i, size_t n, bool guarded) {
+        int kind;
+        size_t start = i;
+        i = scanLexeme(src, i, n, kind);
+        if (guarded && recovery == RECOVER_SKIP_TO_DELIMITER && lexemeIsError(src, kind, start, i)) {
+            i = recoveryEnd(src, kind, start, i, n);
+        }
+        counter.record(kind, i - start);
+        emitToken(out, src, kind, start, i - start);
+        if (guarded && maxErrors != 0 && errorsSeen >= maxErrors) {
+            if (i < n) {
+                out.addError(ERR_TOO_MANY_ERRORS, i, 0);
+            }
+            return n;
+        }
+        return i;
+    }
+    
+    // Body of analyze(); Counter is LexStats or NoStats
+    template <class Counter>
+    void scanAll(Counter& counter) {
+        size_t n = sourceCode.size();
+        size_t i = 0;
+        const char* src = sourceCode.data();
+        const bool guarded = errorPolicyActive();
+        while (i < n) {
+            i = scanStep(*this, counter, src, i, n, guarded);
+        }
+    }
+    
+    // Worker body of analyzeParallel(): lex every lexeme that starts in
+    // [from, to), finishing the one that straddles 'to'
+    static void scanChunk(const char* src, size_t from, size_t to, size_t n, ChunkResult* out) {
+        out->tokens.clear();
+        out->errors.clear();
+        out->boundaries.clear();
+        size_t i = from;
+        while (i < to) {
+            int kind;
+            size_t start = i;
+            i = scanLexeme(src, i, n, kind);
+            out->boundaries.push_back(start);
+            emitToken(*out, src, kind, start, i - start);
+        }
+        out->end = i;
+    }
+    
+#ifdef LEXER_HAVE_MMAP
+    // What analyzeStream() is in the middle of when a block runs out
+    enum StreamMode {
+        STREAM_CODE,
+        STREAM_LINE_COMMENT,
+        STREAM_BLOCK_COMMENT
+    };
+    
+    // Input of analyzeStream(): the bytes read but not lexed yet, and a
+    // running line count that resolves error positions as they are emitted.
+    // Out type for emitToken().
+    struct StreamBuffer {
+        LexicalAnalyzer* lexer;
+        vector<char> bytes;
+        size_t base;            // stream offset of bytes[0]
+        size_t avail;           // bytes filled
+        size_t counted;         // newlines before bytes[counted] are in line
+        uint32_t line;
+        size_t lineStart;       // stream offset where that line starts
+        
+        StreamBuffer(LexicalAnalyzer* owner, size_t blockSize)
+            : lexer(owner), bytes(blockSize), base(0), avail(0), counted(0), line(1), lineStart(0) {}
+        
+        // 1-based line and byte column of bytes[at]; the positions asked
+        // for never go backwards
+        void locate(size_t at, uint32_t& lineOut, uint32_t& column) {
+            const char* p = bytes.data();
+            for (const char* nl = (const char*)memchr(p + counted, '\n', at - counted); nl;
+                 nl = (const char*)memchr(nl + 1, '\n', p + at - nl - 1)) {
+                line++;
+                lineStart = base + (nl - p) + 1;
+            }
+            counted = at;
+            lineOut = line;
+            column = (uint32_t)(base + at - lineStart + 1);
+        }
+        
+        // Drop the bytes before keep (which becomes 0) and read up to
+        // blockSize more behind the rest. Returns what read() returned.
+        ssize_t refill(int fd, size_t& keep, size_t blockSize) {
+            uint32_t lineAtKeep, columnAtKeep;
+            locate(keep, lineAtKeep, columnAtKeep);
+            memmove(bytes.data(), bytes.data() + keep, avail - keep);
+            base += keep;
+            avail -= keep;
+            counted = 0;
+            keep = 0;
+            if (bytes.size() < avail + blockSize) {
+                bytes.resize(avail + blockSize);
+            }
+            ssize_t got;
+            do {
+                got = read(fd, bytes.data() + avail, blockSize);
+            } while (got < 0 && errno == EINTR);
+            if (got > 0) {
+                avail += got;
+            }
+            return got;
+        }
+        
+        void addToken(TokenType type, uint32_t start, uint32_t len) {
+            string_view text(bytes.data() + start, len);
+            Token tok;
+            tok.type = type;
+            tok.offset = (uint32_t)(base + start);
+            tok.length = len;
+            tok.symbol = NO_SYMBOL;
+            lexer->typeCounts[type]++;
+            lexer->sink->onToken(tok, text);
+        }
+        
+        void addError(ErrorKind kind, uint32_t start, uint32_t len) {
+            ErrorRecord rec;
+            rec.kind = kind;
+            rec.offset = (uint32_t)(base + start);
+            rec.length = len;
+            locate(start, rec.line, rec.column);
+            lexer->errorsSeen++;
+            lexer->sink->onErrorAt(rec, errorText(kind, string_view(bytes.data() + start, len)));
+        }
+    };
+#endif
+    
+    static bool tokenBefore(const Token& a, const Token& b) {
+        return a.offset < b.offset;
+    }
+    
+    static bool errorBefore(const LexError& a, const LexError& b) {
+        return a.offset < b.offset;
+    }
+    
+    // Number of leading records whose lexeme was decided by bytes before
+    // 'limit' only: the DFA reads at most LEX_LOOKAHEAD bytes past the end
+    // of a lexeme (the "=:" backtrack)
+    template <class Rec>
+    static size_t recordsSettledBefore(const vector<Rec>& recs, const RecordGap& gap, size_t limit, size_t n) {
+        size_t lo = 0, hi = gap.count(recs);
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            Rec rec = gap.get(recs, mid, n);
+            if ((size_t)rec.offset + rec.length + LEX_LOOKAHEAD <= limit) lo = mid + 1; else hi = mid;
+        }
+        return lo;
+    }
+    
+    // Put the fresh records of an edit into the gap
+    template <class Rec>
+    static void fillGap(vector<Rec>& recs, RecordGap& gap, const vector<Rec>& fresh, size_t n) {
+        gap.move(recs, gap.at, fresh.size(), n);
+        copy(fresh.begin(), fresh.end(), recs.begin() + gap.at);
+        gap.at += fresh.size();
+        gap.len -= fresh.size();
+    }
+    
+    // Close the gaps applyEdit() leaves, for code that walks the records
+    void settleRecords() {
+        tokenGap.close(tokens, sourceCode.size());
+        errorGap.close(errors, sourceCode.size());
+    }
+    
+    // Seed of the cache key: everything besides the source that decides
+    // the results, and the record layout (the byte order changes the hash)
+    uint64_t cacheFingerprint() const {
+        uint64_t parts[8] = { LEX_SPEC_FINGERPRINT, CACHE_VERSION, (uint64_t)recovery, (uint64_t)maxErrors,
+                              (uint64_t)internSymbols, sizeof(Token), sizeof(LexError), sizeof(CacheSymbol) };
+        return contentHash(parts, sizeof(parts), 0);
+    }
+    
+    // Look sourceCode up in the cache and restore the results on a hit.
+    // Sets key for the store after a miss.
+    bool restoreCached(uint64_t& key) {
+        uint64_t fingerprint = cacheFingerprint();
+        key = contentHash(sourceCode.data(), sourceCode.size(), fingerprint);
+        SourceBuffer entry;
+        bool hit = cache->lookup(key, entry) && decodeCached(entry.view(), fingerprint, key);
+#ifndef LEXER_NO_STATS
+        if (stats) {
+            (hit ? stats->cacheHits : stats->cacheMisses)++;
+        }
+#endif
+        return hit;
+    }
+    
+    bool decodeCached(string_view entry, uint64_t fingerprint, uint64_t key) {
+        CacheHeader h;
+        if (entry.size() < sizeof(h)) return false;
+        memcpy(&h, entry.data(), sizeof(h));
+        if (memcmp(h.magic, CACHE_MAGIC, 4) != 0 || h.version != CACHE_VERSION
+            || h.fingerprint != fingerprint || h.contentHash != key || h.sourceSize != sourceCode.size()
+            || h.tokenCount > entry.size() || h.errorCount > entry.size() || h.symbolCount > entry.size()
+            || entry.size() != cacheEntrySize(h.tokenCount, h.errorCount, h.symbolCount)) {
+            return false;
+        }
+        size_t nt = h.tokenCount, ne = h.errorCount, ns = h.symbolCount;
+        // The mapping is page-aligned and every section a multiple of 4 bytes
+        const Token* tokenRecs = (const Token*)(entry.data() + sizeof(h));
+        const LexError* errorRecs = (const LexError*)(tokenRecs + nt);
+        const CacheSymbol* symbolRecs = (const CacheSymbol*)(errorRecs + ne);
+        
+        resetResults();
+        size_t n = sourceCode.size();
+        tokens.reserve(nt);
+        adviseHugePages(tokens.data(), nt * sizeof(Token));
+        tokens.assign(tokenRecs, tokenRecs + nt);
+        errors.assign(errorRecs, errorRecs + ne);
+        pendingSymbols.assign(symbolRecs, symbolRecs + ns);
+        // Checked without branches; NO_SYMBOL + 1 wraps to 0
+        bool bad = false;
+        for (size_t j = 0; j < nt; ++j) {
+            const Token& tok = tokens[j];
+            bad |= (uint8_t)(tok.type - TOK_IDENTIFIER) >= NUM_TOKEN_TYPES - TOK_IDENTIFIER;
+            bad |= (uint64_t)tok.offset + tok.length > n;
+            bad |= (uint32_t)(tok.symbol + 1) > ns;
+        }
+        for (size_t j = 0; j < ne; ++j) {
+            bad |= (uint64_t)errors[j].offset + errors[j].length > n;
+        }
+        for (size_t k = 0; k < ns; ++k) {
+            bad |= (uint64_t)pendingSymbols[k].offset + pendingSymbols[k].length > n;
+        }
+        size_t counted = 0;
+        for (int t = TOK_IDENTIFIER; t < NUM_TOKEN_TYPES; ++t) {
+            typeCounts[t] = h.typeCounts[t];
+            counted += typeCounts[t];
+        }
+        if (bad || counted != nt) {
+            resetResults();
+            return false;
+        }
+        errorsSeen = ne;
+        typeIndexStale = true;
+        resultsCurrent = true;
+        return true;
+    }
+    
+    // Build the symbol table of a cache hit, whose names are still in the
+    // source
+    void restoreSymbols() const {
+        if (pendingSymbols.empty()) return;
+        size_t textBytes = 0;
+        for (size_t k = 0; k < pendingSymbols.size(); ++k) {
+            textBytes += pendingSymbols[k].length;
+        }
+        char* text = symbols.resizeBulk(pendingSymbols.size(), textBytes);
+        for (size_t k = 0; k < pendingSymbols.size(); ++k) {
+            const CacheSymbol& sym = pendingSymbols[k];
+            memcpy(text, sourceCode.slice(sym.offset, sym.length).data(), sym.length);
+            symbols.setBulk(k, string_view(text, sym.length), sym.hash, sym.type, sym.count);
+            text += sym.length;
+        }
+        pendingSymbols.clear();
+    }
+    
+    // Store the results of a full analysis under key. Symbols are written
+    // in id order with their first occurrence, which is where analyze()
+    // interned them.
+    void storeCached(uint64_t key) {
+        settleRecords();
+        restoreSymbols();
+        size_t nt = tokens.size(), ne = errors.size(), ns = symbols.size();
+        vector<uint32_t> firstToken(ns, NO_SYMBOL);
+        for (size_t j = 0; j < nt; ++j) {
+            uint32_t id = tokens[j].symbol;
+            if (id != NO_SYMBOL && firstToken[id] == NO_SYMBOL) {
+                firstToken[id] = j;
+            }
+        }
+        for (size_t k = 0; k < ns; ++k) {
+            if (firstToken[k] == NO_SYMBOL) return;     // not produced by analyze()
+        }
+        
+        string out(cacheEntrySize(nt, ne, ns), '\0');
+        CacheHeader h;
+        memset(&h, 0, sizeof(h));
+        memcpy(h.magic, CACHE_MAGIC, 4);
+        h.version = CACHE_VERSION;
+        h.fingerprint = cacheFingerprint();
+        h.contentHash = key;
+        h.sourceSize = sourceCode.size();
+        h.tokenCount = nt;
+        h.errorCount = ne;
+        h.symbolCount = ns;
+        for (int t = TOK_IDENTIFIER; t < NUM_TOKEN_TYPES; ++t) {
+            h.typeCounts[t] = typeCounts[t];
+        }
+        char* p = &out[0];
+        memcpy(p, &h, sizeof(h));
+        p += sizeof(h);
+        // Field by field, so the padding stays zero
+        for (size_t j = 0; j < nt; ++j, p += sizeof(Token)) {
+            Token* rec = (Token*)p;
+            rec->type = tokens[j].type;
+            rec->offset = tokens[j].offset;
+            rec->length = tokens[j].length;
+            rec->symbol = tokens[j].symbol;
+        }
+        for (size_t j = 0; j < ne; ++j, p += sizeof(LexError)) {
+            LexError* rec = (LexError*)p;
+            rec->kind = errors[j].kind;
+            rec->offset = errors[j].offset;
+            rec->length = errors[j].length;
+        }
+        for (size_t k = 0; k < ns; ++k, p += sizeof(CacheSymbol)) {
+            CacheSymbol* rec = (CacheSymbol*)p;
+            rec->type = symbols.type(k);
+            rec->offset = tokens[firstToken[k]].offset;
+            rec->length = tokens[firstToken[k]].length;
+            rec->count = symbols.count(k);
+            rec->hash = symbols.hashOf(k);
+        }
+        cache->store(key, out);
+    }
+    
+public:
+    LexicalAnalyzer(): sink(NULL), resultsCurrent(false), internSymbols(false), stats(NULL), cache(NULL),
+                       memoryLimit(SIZE_MAX), recovery(RECOVER_NONE), maxErrors(0), errorsSeen(0),
+                       errorPositions(false) {
+        resetTypeIndex();
+    }
+    
+    // How analyze() treats errors. With RECOVER_SKIP_TO_DELIMITER an error
+    // swallows the rest of the malformed text (see recoveryEnd()); with
+    // maxErrors > 0 the scan stops after that many errors and a final
+    // ERR_TOO_MANY_ERRORS record marks where. Either setting makes
+    // applyEdit() and analyzeParallel() fall back to a full analyze().
+    void setErrorRecovery(RecoveryMode mode, size_t errorLimit = 0) {
+        recovery = mode;
+        maxErrors = errorLimit;
+        resultsCurrent = false;
+    }
+    
+    // Print and export errors as "line:column: text (kind)" instead of the
+    // bare text the original scanner wrote; off by default
+    void setErrorPositions(bool on) {
+        errorPositions = on;
+    }
+    
+    // Cap on the memory kept reserved for tokens, errors, the type index,
+    // the symbol table and the per-chunk buffers of analyzeParallel()
+    // between runs; default no cap
+    void setMemoryLimit(size_t bytes) {
+        memoryLimit = bytes;
+    }
+    
+    size_t memoryBytes() const {
+        size_t bytes = tokens.capacity() * sizeof(Token) + errors.capacity() * sizeof(LexError);
+        for (int t = 0; t < NUM_TOKEN_TYPES; ++t) {
+            bytes += typeIndex[t].capacity() * sizeof(uint32_t);
+        }
+        for (size_t k = 0; k < chunkResults.size(); ++k) {
+            bytes += chunkResults[k].memoryBytes();
+        }
+        for (size_t p = 0; p < symbolShards.size(); ++p) {
+            bytes += symbolShards[p].memoryBytes();
+        }
+        return bytes + symbols.memoryBytes() + pendingSymbols.capacity() * sizeof(CacheSymbol);
+    }
+    
+    // Attach counters that loading, analyze() and the exports add to (NULL
+    // detaches). Per-lexeme counts come from analyze() only;
+    // analyzeParallel() and applyEdit() are not instrumented.
+    void setStats(LexStats* counters) {
+        stats = counters;
+    }
+    
+    // Reuse results across runs (NULL detaches): analyze() and
+    // analyzeParallel() first look the source up in the cache and only scan
+    // on a miss, storing what they found. A hit costs one hash of the source
+    // plus copying the entry in; it adds to the cache counters of the stats
+    // but not to the per-lexeme ones. Streaming to a sink bypasses the cache.
+    void setCache(const ResultCache* resultCache) {
+        cache = resultCache;
+    }
+    
+    bool loadFromFile(const string& filename) {
+        StatTimer timer(stats, PHASE_LOAD);
+        restoreSymbols();
+        resultsCurrent = false;
+        return sourceCode.loadFile(filename);
+    }
+    
+    void setSourceCode(const string& src) {
+        restoreSymbols();
+        resultsCurrent = false;
+        sourceCode.assign(src);
+    }
+    
+    // Intern identifier and number lexemes (Token::symbol, symbolTable(),
+    // printTopIdentifiers()). Off by default: interning is the largest part
+    // of the scan time and its table grows with the number of distinct
+    // lexemes. analyze() with a sink never interns, so it stays in constant
+    // memory.
+    void setSymbolInterning(bool on) {
+        internSymbols = on;
+        resultsCurrent = false;
+    }
+    
+    // Scan sourceCode. With a sink, every token and error is handed to it
+    // as soon as it is recognized and nothing is kept in the analyzer.
+    void analyze(TokenSink* output = NULL) {
+        StatTimer timer(stats, PHASE_ANALYZE);
+        uint64_t cacheKey = 0;
+        if (cache && !output && restoreCached(cacheKey)) {
+            return;
+        }
+        resetResults();
+        sink = output;
+#ifndef LEXER_NO_STATS
+        if (stats) {
+            LexStats counts;
+            scanAll(counts);
+            counts.keywordHits = typeCounts[TOK_KEYWORD];
+            stats->merge(counts);
+        } else
+#endif
+        {
+            NoStats none;
+            scanAll(none);
+        }
+        resultsCurrent = (sink == NULL);
+        sink = NULL;
+        if (cache && !output) {
+            storeCached(cacheKey);
+        }
+    }
+    
+    // Pull interface for a parser: tokens are scanned only as the caller
+    // asks for them, with up to LOOKAHEAD tokens of lookahead, so parsing
+    // overlaps lexing and a parser that gives up early leaves the rest of
+    // the input unread. Errors are collected in the analyzer as usual
+    // (errorCount(), errorAt()); symbols and per-type counts are kept, the
+    // tokens themselves are not. Not instrumented by setStats(). The stream
+    // is invalidated by anything that replaces or re-analyzes the source.
+    //
+    //     LexicalAnalyzer::TokenStream in = lexer.tokenStream();
+    //     while (const Token* tok = in.peek()) { ... in.next(t); }
+    //     for (const Token& tok : lexer.tokenStream()) { ... }
+    class TokenStream {
+    public:
+        static const size_t LOOKAHEAD = 4;
+        
+    private:
+        friend class LexicalAnalyzer;
+        
+        LexicalAnalyzer* lexer;
+        size_t pos;                 // start of the next lexeme to scan
+        Token ahead[LOOKAHEAD];     // ring buffer of scanned, unread tokens
+        size_t head;
+        size_t count;
+        
+        explicit TokenStream(LexicalAnalyzer* owner): lexer(owner), pos(0), head(0), count(0) {}
+        
+        // Called by emitToken()
+        void addToken(TokenType type, uint32_t start, uint32_t len) {
+            Token& tok = ahead[(head + count++) % LOOKAHEAD];
+            tok.type = type;
+            tok.offset = start;
+            tok.length = len;
+            tok.symbol = lexer->symbolFor(type, start, len);
+            lexer->typeCounts[type]++;
+        }
+        
+        void addError(ErrorKind kind, uint32_t start, uint32_t len) {
+            lexer->addError(kind, start, len);
+        }
+        
+        // Scan until token k is buffered; false when the input ends first.
+        // A lexeme yields at most one token, so the buffer never overflows.
+        bool fill(size_t k) {
+            size_t n = lexer->sourceCode.size();
+            const char* src = lexer->sourceCode.data();
+            const bool guarded = lexer->errorPolicyActive();
+            NoStats none;
+            while (count <= k && pos < n) {
+                pos = lexer->scanStep(*this, none, src, pos, n, guarded);
+            }
+            return count > k;
+        }
+        
+    public:
+        // Token k places ahead (0 = the next one), or NULL when the input
+        // ends before it. Throws out_of_range for k >= LOOKAHEAD, which the
+        // buffer cannot hold, rather than reporting a false end of input.
+        const Token* peek(size_t k = 0) {
+            if (k >= LOOKAHEAD) {
+                throw out_of_range("TokenStream::peek: lookahead beyond LOOKAHEAD");
+            }
+            if (!fill(k)) return NULL;
+            return &ahead[(head + k) % LOOKAHEAD];
+        }
+        
+        // Consume the next token; false at the end of the input
+        bool next(Token& tok) {
+            if (!fill(0)) return false;
+            tok = ahead[head];
+            head = (head + 1) % LOOKAHEAD;
+            count--;
+            return true;
+        }
+        
+        string_view lexeme(const Token& tok) const {
+            return lexer->lexeme(tok);
+        }
+        
+        // Bytes of input scanned so far
+        size_t position() const { return pos; }
+        
+        // Input iterator for range-for: * peeks at the next token, ++
+        // consumes it
+        class iterator {
+        private:
+            TokenStream* stream;
+            
+        public:
+            explicit iterator(TokenStream* s): stream(s) {}
+            const Token& operator*() const { return *stream->peek(); }
+            const Token* operator->() const { return stream->peek(); }
+            iterator& operator++() {
+                Token consumed;
+                stream->next(consumed);
+                return *this;
+            }
+            bool atEnd() const { return stream == NULL || stream->peek() == NULL; }
+            bool operator==(const iterator& other) const { return atEnd() == other.atEnd(); }
+            bool operator!=(const iterator& other) const { return atEnd() != other.atEnd(); }
+        };
+        
+        iterator begin() { return iterator(this); }
+        iterator end() { return iterator(NULL); }
+    };
+    
+    // Start pulling tokens from the beginning of the source. Clears the
+    // results of the previous analysis like analyze() does.
+    TokenStream tokenStream() {
+        resetResults();
+        resultsCurrent = false;
+        return TokenStream(this);
+    }
+    
+#ifdef LEXER_HAVE_MMAP
+    // Lex everything readable from fd (stdin, a pipe, a socket, a file) as
+    // it arrives, handing tokens and errors to output. Input is read in
+    // blocks of blockSize bytes into a buffer that keeps only the lexeme
+    // still being read across a block boundary, so memory stays at about
+    // blockSize plus the longest token whatever the input size, and the
+    // first tokens reach the sink before the input ends.
+    //
+    // A lexeme that ends within LEX_LOOKAHEAD bytes of the data read so far
+    // might still grow, so it is scanned again from its start once the next
+    // block is in. Whitespace is cut at the block end, and an open comment
+    // is carried over as a mode instead of being kept: the next block
+    // continues the comment at its first byte. Under
+    // RECOVER_SKIP_TO_DELIMITER an open comment is kept after all, since
+    // if it never closes it is an error up to the end of its line and the
+    // rest is lexed again; only the new bytes are searched for the "*/".
+    // Results are as from analyze(), with offsets wrapping past 4 GiB.
+    // Like analyze() with a sink it never interns symbols, whatever
+    // setSymbolInterning() says: nothing the analyzer keeps grows with the
+    // input. Returns false when reading fails.
+    bool analyzeStream(int fd, TokenSink* output, size_t blockSize = STREAM_BLOCK_SIZE) {
+        StatTimer timer(stats, PHASE_ANALYZE);
+        resetResults();
+        resultsCurrent = false;
+        sink = output;
+        blockSize = max(blockSize, (size_t)LEX_LOOKAHEAD);
+        StreamBuffer in(this, blockSize);
+        const bool guarded = errorPolicyActive();
+        const bool keepComments = guarded && recovery == RECOVER_SKIP_TO_DELIMITER;
+        StreamMode mode = STREAM_CODE;
+        ErrorRecord comment;    // where the open /* comment starts
+        size_t i = 0;           // first byte of in.bytes not lexed yet
+        size_t scan = 0;        // in a block comment: where to look for "*/"
+        bool eof = false;
+        bool stopped = false;   // max-errors cutoff reached
+        bool ok = true;
+        while (ok) {
+            const char* src = in.bytes.data();
+            size_t n = in.avail;
+            while (i < n && !stopped) {
+                if (mode == STREAM_BLOCK_COMMENT) {
+                    size_t close = runKernels.commentCloseAt(src, scan, n);
+                    if (close < n) {
+                        i = close + 2;
+                        mode = STREAM_CODE;
+                        continue;
+                    }
+                    // keep a final '*' that the next block may close, but
+                    // not the one of the opening /*
+                    scan = (scan < n && src[n - 1] == '*') ? n - 1 : n;
+                    if (keepComments && eof) {
+                        mode = STREAM_CODE;     // lex it again as unterminated
+                        continue;
+                    }
+                    if (!keepComments) {
+                        i = scan;
+                    }
+                    break;
+                }
+                if (mode == STREAM_LINE_COMMENT) {
+                    const char* nl = (const char*)memchr(src + i, '\n', n - i);
+                    if (!nl) {
+                        i = n;
+                        break;
+                    }
+                    i = nl - src;
+                    mode = STREAM_CODE;
+                    continue;
+                }
+                int kind;
+                size_t start = i;
+                size_t end = scanLexeme(src, i, n, kind);
+                if (!eof && end + LEX_LOOKAHEAD > n) {
+                    if (kind == ACC_SKIP) {
+                        i = end;
+                        continue;
+                    }
+                    if (kind == ACC_COMMENT && src[start + 1] == '/' && end == n) {
+                        mode = STREAM_LINE_COMMENT;
+                        i = end;
+                        continue;
+                    }
+                    if (kind == ACC_UNTERMINATED) {
+                        comment.kind = ERR_UNTERMINATED_COMMENT;
+                        comment.offset = (uint32_t)(in.base + start);
+                        in.locate(start, comment.line, comment.column);
+                        mode = STREAM_BLOCK_COMMENT;
+                        scan = start + 2;
+                        if (!keepComments) {
+                            i = scan;
+                        }
+                        continue;
+                    }
+                    if (kind != ACC_COMMENT) {
+                        break;      // may go on in the next block
+                    }
+                }
+                if (guarded && recovery == RECOVER_SKIP_TO_DELIMITER && lexemeIsError(src, kind, start, end)) {
+                    size_t recoveredEnd = recoveryEnd(src, kind, start, end, n);
+                    if (recoveredEnd == n && !eof) {
+                        break;
+                    }
+                    end = recoveredEnd;
+                }
+                emitToken(in, src, kind, start, end - start);
+                i = end;
+                stopped = guarded && maxErrors != 0 && errorsSeen >= maxErrors;
+            }
+            if (stopped) {
+                // like analyze(), mark the cutoff unless the input ends there
+                if (i == n && !eof) {
+                    ok = in.refill(fd, i, blockSize) >= 0;
+                }
+                if (i < in.avail) {
+                    in.addError(ERR_TOO_MANY_ERRORS, i, 0);
+                }
+                break;
+            }
+            if (eof) {
+                break;
+            }
+            sink->flush();
+            scan -= i;
+            ssize_t got = in.refill(fd, i, blockSize);
+            ok = got >= 0;
+            eof = got == 0;
+        }
+        if (ok && mode == STREAM_BLOCK_COMMENT && !stopped && !keepComments) {
+            comment.length = (uint32_t)(in.base + in.avail - comment.offset);
+            errorsSeen++;
+            sink->onErrorAt(comment, errorText(ERR_UNTERMINATED_COMMENT, string_view()));
+        }
+        sink->flush();
+        sink = NULL;
+        return ok;
+    }
+#endif
+    
+    // Replace removedLen bytes at offset with inserted and bring the tokens
+    // and errors up to date by re-lexing only the damaged region.
+    //
+    // Scanning restarts at the end of the last token that the edit cannot
+    // have influenced. The new lexemes are compared against the old stream:
+    // as soon as one ends past the edit at a position where an old lexeme
+    // (shifted by the size change) also began, both streams are between
+    // tokens at the same text and everything after is kept. Opening a /*
+    // therefore re-lexes up to the next */, closing one up to the first
+    // token after it. If the previous analysis was streamed to a sink, the
+    // whole buffer is analyzed instead.
+    //
+    // The text and the records keep a gap where the last edit was (see
+    // RecordGap), so the cost depends on the distance to the previous edit
+    // and not on the size of the file. Reading all records afterwards
+    // closes the record gaps.
+    bool applyEdit(size_t offset, size_t removedLen, string_view inserted) {
+        size_t oldSize = sourceCode.size();
+        if (offset > oldSize || removedLen > oldSize - offset
+            || oldSize - removedLen + inserted.size() > MAX_SOURCE_SIZE) {
+            return false;
+        }
+        if (!resultsCurrent || errorPolicyActive()) {
+            sourceCode.replace(offset, removedLen, inserted);
+            analyze();
+            return true;
+        }
+        
+        restoreSymbols();
+        size_t tokFrom = recordsSettledBefore(tokens, tokenGap, offset, oldSize);
+        size_t errFrom = recordsSettledBefore(errors, errorGap, offset, oldSize);
+        size_t pos = 0;
+        if (tokFrom > 0) {
+            Token tok = tokenGap.get(tokens, tokFrom - 1, oldSize);
+            pos = max(pos, (size_t)tok.offset + tok.length);
+        }
+        if (errFrom > 0) {
+            LexError err = errorGap.get(errors, errFrom - 1, oldSize);
+            pos = max(pos, (size_t)err.offset + err.length);
+        }
+        tokenGap.move(tokens, tokFrom, 0, oldSize);
+        errorGap.move(errors, errFrom, 0, oldSize);
+        
+        sourceCode.replace(offset, removedLen, inserted);
+        size_t n = sourceCode.size();
+        const char* src = sourceCode.suffixFrom(pos);
+        size_t newDamageEnd = offset + inserted.size();
+        
+        ChunkResult fresh;
+        size_t sync = n;        // where the streams meet
+        while (pos < n) {
+            int kind;
+            size_t start = pos;
+            pos = scanLexeme(src, pos, n, kind);
+            emitToken(fresh, src, kind, start, pos - start);
+            if (pos >= newDamageEnd
+                && (tokenGap.boundaryAfterAt(tokens, pos, n) || errorGap.boundaryAfterAt(errors, pos, n))) {
+                sync = pos;
+                break;
+            }
+        }
+        
+        size_t tokTo = tokenGap.firstAfterFrom(tokens, sync, n);
+        size_t errTo = errorGap.firstAfterFrom(errors, sync, n);
+        for (size_t j = tokFrom; j < tokTo; ++j) {
+            const Token& tok = tokens[j + tokenGap.len];
+            typeCounts[tok.type]--;
+            symbols.release(tok.symbol);
+        }
+        for (size_t j = 0; j < fresh.tokens.size(); ++j) {
+            Token& tok = fresh.tokens[j];
+            typeCounts[tok.type]++;
+            tok.symbol = symbolFor(tok.type, tok.offset, tok.length);
+        }
+        typeIndexStale = true;
+        tokenGap.len += tokTo - tokFrom;
+        errorGap.len += errTo - errFrom;
+        fillGap(tokens, tokenGap, fresh.tokens, n);
+        fillGap(errors, errorGap, fresh.errors, n);
+        return true;
+    }
+    
+    // Run task(0) .. task(count - 1) on separate threads
+    template <class Task>
+    static void runTasks(size_t count, Task task) {
+        vector<thread> workers;
+        workers.reserve(count);
+        for (size_t k = 1; k < count; ++k) {
+            workers.push_back(thread(task, k));
+        }
+        task(0);
+        for (size_t k = 0; k < workers.size(); ++k) {
+            workers[k].join();
+        }
+    }
+    
+    // Number the symbols of a chunk's result tokens in its own table
+    static void internChunk(const char* src, ChunkResult& r) {
+        r.symbols.clear();
+        for (size_t j = r.tokenFrom; j < r.tokens.size(); ++j) {
+            Token& tok = r.tokens[j];
+            if (tok.type == TOK_IDENTIFIER || tok.type == TOK_NUMBER) {
+                tok.symbol = r.symbols.intern(string_view(src + tok.offset, tok.length), tok.type);
+            }
+        }
+        r.remap.assign(r.symbols.size(), NO_SYMBOL);
+    }
+    
+    // Shard p of the symbols of all chunks, taken in chunk order so the
+    // first chunk to have a symbol owns it
+    static void collectShard(vector<ChunkResult>& results, vector<SymbolShard>& shards, size_t p) {
+        SymbolShard& shard = shards[p];
+        shard.table.clear();
+        shard.owner.clear();
+        shard.textBytes = 0;
+        for (size_t k = 0; k < results.size(); ++k) {
+            ChunkResult& r = results[k];
+            for (uint32_t id = 0; id < r.symbols.size(); ++id) {
+                uint32_t h = r.symbols.hashOf(id);
+                if (SymbolShard::of(h, shards.size()) != p) continue;
+                size_t before = shard.table.size();
+                string_view name = r.symbols.name(id);
+                r.remap[id] = shard.table.intern(name, h, r.symbols.type(id), r.symbols.count(id));
+                if (shard.table.size() != before) {
+                    shard.owner.push_back(k);
+                    shard.textBytes += name.size();
+                }
+            }
+        }
+        shard.finalId.resize(shard.table.size());
+    }
+    
+    // The symbols chunk k has first get consecutive final ids from
+    // firstId on, in the order the chunk met them: the order analyze()
+    // numbers them in. Returns how many there are.
+    static size_t numberChunkSymbols(vector<ChunkResult>& results, vector<SymbolShard>& shards, size_t k,
+                                     size_t firstId, bool countOnly) {
+        ChunkResult& r = results[k];
+        size_t own = 0;
+        for (uint32_t id = 0; id < r.symbols.size(); ++id) {
+            SymbolShard& shard = shards[SymbolShard::of(r.symbols.hashOf(id), shards.size())];
+            if (shard.owner[r.remap[id]] != k) continue;
+            if (!countOnly) {
+                shard.finalId[r.remap[id]] = firstId + own;
+            }
+            own++;
+        }
+        return own;
+    }
+    
+    // Copy chunk k's result tokens into place with their final symbol ids,
+    // and shard k's symbols into the symbol table
+    void placeChunk(vector<ChunkResult>& results, vector<SymbolShard>& shards, size_t k, char* text) {
+        ChunkResult& r = results[k];
+        if (internSymbols) {
+            for (uint32_t id = 0; id < r.symbols.size(); ++id) {
+                SymbolShard& shard = shards[SymbolShard::of(r.symbols.hashOf(id), shards.size())];
+                r.remap[id] = shard.finalId[r.remap[id]];
+            }
+        }
+        for (int t = 0; t < NUM_TOKEN_TYPES; ++t) {
+            r.typeCounts[t] = 0;
+        }
+        Token* out = tokens.data() + r.tokenBase;
+        for (size_t j = r.tokenFrom; j < r.tokens.size(); ++j) {
+            Token tok = r.tokens[j];
+            if (tok.symbol != NO_SYMBOL) {
+                tok.symbol = r.remap[tok.symbol];
+            }
+            r.typeCounts[tok.type]++;
+            *out++ = tok;
+        }
+        if (!internSymbols) return;
+        SymbolShard& shard = shards[k];
+        char* dst = text + shard.textBase;
+        for (uint32_t id = 0; id < shard.table.size(); ++id) {
+            string_view name = shard.table.name(id);
+            memcpy(dst, name.data(), name.size());
+            symbols.setBulk(shard.finalId[id], string_view(dst, name.size()), shard.table.hashOf(id),
+                            shard.table.type(id), shard.table.count(id));
+            dst += name.size();
+        }
+    }
+    
+    // Same result as analyze(), with the source split into chunks that are
+    // lexed on separate threads (0 = one per core).
+    //
+    // A chunk boundary can fall inside a comment, identifier or number, so
+    // each worker lexes its chunk speculatively from the start state. The
+    // merge then walks the chunks in order: the true token stream coming
+    // out of chunk k-1 ends at some position; if chunk k also has a lexeme
+    // starting there, both streams are in the same state (between tokens)
+    // and chunk k is taken over from that point. Otherwise lexemes are
+    // re-scanned sequentially until such a shared boundary is reached,
+    // which is normally within one token or comment.
+    void analyzeParallel(unsigned threads = 0) {
+        const size_t MIN_CHUNK = 1 << 18;
+        const size_t SYNC_SEARCH = 4096;
+        sink = NULL;
+        size_t n = sourceCode.size();
+        const char* src = sourceCode.data();
+        if (threads == 0) {
+            threads = thread::hardware_concurrency();
+        }
+        size_t chunks = min((size_t)max(threads, 1u), n / MIN_CHUNK);
+        if (chunks <= 1 || errorPolicyActive()) {
+            analyze();
+            return;
+        }
+        uint64_t cacheKey = 0;
+        if (cache && restoreCached(cacheKey)) {
+            return;
+        }
+        resetResults();
+        
+        // Chunk starts, moved just past a newline when one is close so most
+        // workers already begin on a token boundary
+        vector<size_t> starts(chunks + 1);
+        starts[0] = 0;
+        starts[chunks] = n;
+        for (size_t k = 1; k < chunks; ++k) {
+            size_t p = n / chunks * k;
+            const char* nl = (const char*)memchr(src + p, '\n', min(SYNC_SEARCH, n - p));
+            starts[k] = nl ? (size_t)(nl - src) + 1 : p;
+        }
+        
+        // The chunk buffers keep their capacity from run to run
+        vector<ChunkResult>& results = chunkResults;
+        results.resize(chunks);
+        runTasks(chunks, [&](size_t k) {
+            scanChunk(src, starts[k], starts[k + 1], n, &results[k]);
+        });
+        
+        // Find where each chunk falls into step with the true token stream.
+        // Lexemes re-scanned on the way are appended to the chunk before, so
+        // the result is every chunk's records from tokenFrom/errorFrom on.
+        results[0].tokenFrom = 0;
+        results[0].errorFrom = 0;
+        size_t pos = results[0].end;
+        for (size_t k = 1; k < chunks; ++k) {
+            ChunkResult& r = results[k];
+            r.tokenFrom = r.tokens.size();
+            r.errorFrom = r.errors.size();
+            while (pos < r.end) {
+                if (binary_search(r.boundaries.begin(), r.boundaries.end(), (uint32_t)pos)) {
+                    Token keyTok = Token();
+                    keyTok.offset = pos;
+                    LexError keyErr = LexError();
+                    keyErr.offset = pos;
+                    r.tokenFrom = lower_bound(r.tokens.begin(), r.tokens.end(), keyTok, tokenBefore) - r.tokens.begin();
+                    r.errorFrom = lower_bound(r.errors.begin(), r.errors.end(), keyErr, errorBefore) - r.errors.begin();
+                    pos = r.end;
+                    break;
+                }
+                int kind;
+                size_t start = pos;
+                pos = scanLexeme(src, pos, n, kind);
+                emitToken(results[k - 1], src, kind, start, pos - start);
+            }
+        }
+        
+        // Symbols: every chunk numbers its own, hash shards find the chunk
+        // that has each one first, then each chunk hands out final ids to
+        // the symbols it owns. Only the prefix sums are serial.
+        vector<SymbolShard>& shards = symbolShards;
+        shards.resize(internSymbols ? chunks : 0);
+        if (internSymbols) {
+            runTasks(chunks, [&](size_t k) { internChunk(src, results[k]); });
+            runTasks(chunks, [&](size_t p) { collectShard(results, shards, p); });
+            runTasks(chunks, [&](size_t k) {
+                results[k].newSymbols = numberChunkSymbols(results, shards, k, 0, true);
+            });
+            size_t firstId = 0;
+            for (size_t k = 0; k < chunks; ++k) {
+                size_t own = results[k].newSymbols;
+                results[k].newSymbols = firstId;
+                firstId += own;
+            }
+            runTasks(chunks, [&](size_t k) {
+                numberChunkSymbols(results, shards, k, results[k].newSymbols, false);
+            });
+        }
+        
+        size_t total = 0, textBytes = 0, symbolCount = 0;
+        for (size_t k = 0; k < chunks; ++k) {
+            results[k].tokenBase = total;
+            total += results[k].tokens.size() - results[k].tokenFrom;
+        }
+        for (size_t p = 0; p < shards.size(); ++p) {
+            shards[p].textBase = textBytes;
+            textBytes += shards[p].textBytes;
+            symbolCount += shards[p].table.size();
+        }
+        char* text = internSymbols ? symbols.resizeBulk(symbolCount, textBytes) : NULL;
+        tokens.resize(total);
+        runTasks(chunks, [&](size_t k) { placeChunk(results, shards, k, text); });
+        for (size_t k = 0; k < chunks; ++k) {
+            ChunkResult& r = results[k];
+            errors.insert(errors.end(), r.errors.begin() + r.errorFrom, r.errors.end());
+            for (int t = 0; t < NUM_TOKEN_TYPES; ++t) {
+                typeCounts[t] += r.typeCounts[t];
+            }
+        }
+        // The per-type index lists are rebuilt on first use
+        typeIndexStale = true;
+        resultsCurrent = true;
+        if (memoryBytes() > memoryLimit) {
+            releaseParallelBuffers();
+        }
+        if (cache) {
+            storeCached(cacheKey);
+        }
+    }
+    
+    // Text of a token; valid until the source code is replaced
+    string_view lexeme(const Token& tok) const {
+        return sourceCode.slice(tok.offset, tok.length);
+    }
+    
+    // Text printed for an error
+    string_view errorText(const LexError& err) const {
+        return errorText(err.kind, sourceCode.slice(err.offset, err.length));
+    }
+    
+    // The same for an error whose source text is 'text'
+    static string_view errorText(ErrorKind kind, string_view text) {
+        if (kind == ERR_UNTERMINATED_COMMENT) {
+            return "/*... (unterminated comment)";
+        }
+        if (kind == ERR_TOO_MANY_ERRORS) {
+            return "(too many errors, analysis stopped)";
+        }
+        return text;
+    }
+    
+    // The error with its line and column; the first call after the source
+    // changed indexes the line starts
+    ErrorRecord errorRecord(const LexError& err) const {
+        ErrorRecord rec;
+        rec.kind = err.kind;
+        rec.offset = err.offset;
+        rec.length = err.length;
+        sourceCode.locate(err.offset, rec.line, rec.column);
+        return rec;
+    }
+    
+    ErrorRecord errorAt(size_t j) const {
+        return errorRecord(errorGap.get(errors, j, sourceCode.size()));
+    }
+    
+    // An error as printed and exported: its text, or with
+    // setErrorPositions() "line:column: text (kind)"
+    void writeError(ostream& out, const LexError& err) const {
+        if (!errorPositions) {
+            out << errorText(err);
+            return;
+        }
+        writeError(out, errorRecord(err), errorText(err));
+    }
+    
+    // "line:column: text (kind)"; also for errors that analyzeStream()
+    // reports with their position resolved
+    static void writeError(ostream& out, const ErrorRecord& rec, string_view text) {
+        out << rec.line << ':' << rec.column << ": " << text;
+        if (rec.kind != ERR_UNTERMINATED_COMMENT && rec.kind != ERR_TOO_MANY_ERRORS) {
+            out << " (" << errorKindName(rec.kind) << ")";
+        }
+    }
+    
+    size_t sourceSize() const { return sourceCode.size(); }
+    string_view source() const { return sourceCode.view(); }
+    size_t tokenCount() const { return tokenGap.count(tokens); }
+    size_t errorCount() const { return errorGap.count(errors); }
+    
+    // Token j; cheap between edits, unlike a full walk
+    Token tokenAt(size_t j) const { return tokenGap.get(tokens, j, sourceCode.size()); }
+    
+    const SymbolTable& symbolTable() const {
+        restoreSymbols();
+        return symbols;
+    }
+    
+    // "Most frequent identifiers" report from the symbol table
+    void printTopIdentifiers(ostream& out, size_t limit) const {
+        restoreSymbols();
+        vector<uint32_t> top = symbols.mostFrequent(TOK_IDENTIFIER, limit);
+        out << "Most frequent identifiers:\n";
+        for (size_t j = 0; j < top.size(); ++j) {
+            out << "  " << symbols.name(top[j]) << " " << symbols.count(top[j]) << "\n";
+        }
+        if (top.empty()) {
+            out << "  (None)\n";
+        }
+    }
+    
+    // Number of tokens of one type; also counts tokens streamed to a sink
+    size_t tokenCountOf(int type) const {
+        return (type >= TOK_IDENTIFIER && type < NUM_TOKEN_TYPES) ? typeCounts[type] : 0;
+    }
+    
+    // Utility methods to retrieve or display the results:
+    void printAllTokens() {
+        settleRecords();
+        for (int j = 0; j < (int)tokens.size(); ++j) {
+            cout << lexeme(tokens[j]) << " -> " << tokenTypeName(tokens[j].type) << endl;
+        }
+        if (tokens.empty()) {
+            cout << "(No tokens)" << endl;
+        }
+    }
+    
+    void viewTokensByType(int typeOption) {
+        if (typeOption < TOK_IDENTIFIER || typeOption > TOK_KEYWORD) {
+            return;
+        }
+        ensureTypeIndex();
+        const vector<uint32_t>& index = typeIndex[typeOption];
+        cout << tokenTypeName(typeOption) << " Tokens:" << endl;
+        for (size_t j = 0; j < index.size(); ++j) {
+            cout << lexeme(tokens[index[j]]) << endl;
+        }
+        if (index.empty()) {
+            cout << "(None)" << endl;
+        }
+    }
+    
+    void printErrors() {
+        settleRecords();
+        if (errors.empty()) {
+            cout << "No errors found." << endl;
+        } else {
+            cout << "Error tokens:" << endl;
+            for (int j = 0; j < (int)errors.size(); ++j) {
+                writeError(cout, errors[j]);
+                cout << endl;
+            }
+        }
+    }
+    
+    bool exportToFiles(const string& tokenFile = "Token.txt", const string& errorFile = "Error.txt") {
+        StatTimer timer(stats, PHASE_EXPORT);
+        settleRecords();
+        ofstream fout1(tokenFile.c_str());
+        if (!fout1) return false;
+        for (int j = 0; j < (int)tokens.size(); ++j) {
+            fout1 << lexeme(tokens[j]) << " -> " << tokenTypeName(tokens[j].type) << '\n';
+        }
+        fout1.close();
+        ofstream fout2(errorFile.c_str());
+        if (!fout2) return false;
+        for (int j = 0; j < (int)errors.size(); ++j) {
+            writeError(fout2, errors[j]);
+            fout2 << '\n';
+        }
+        fout2.close();
+        return !fout1.fail() && !fout2.fail();
+    }
+    
+    // Write the results in the binary token file format (see above).
+    // Records are encoded into a 1 MB buffer that is written out whole.
+    bool exportBinary(const string& filename, bool withLexemes = true) {
+        StatTimer timer(stats, PHASE_EXPORT);
+        settleRecords();
+        ofstream fout(filename.c_str(), ios::binary);
+        if (!fout) return false;
+        string buf;
+        buf.reserve(TOKFILE_WRITE_BLOCK + 64);
+        buf.assign(TOKFILE_HEADER_SIZE, '\0');
+        
+        // Real sources repeat most lexemes; a sixteenth of the records is
+        // room for the distinct ones of typical code
+        LexemeIndex table;
+        if (withLexemes) {
+            table.reserve((tokens.size() + errors.size()) / 16);
+        }
+        // With interning on, identifiers and numbers are looked up by symbol
+        // id instead of by text
+        vector<uint32_t> lexemeOfSymbol(withLexemes ? symbols.size() : 0, NO_SYMBOL);
+        uint64_t written = 0;
+        
+        uint32_t prevEnd = 0;
+        for (size_t j = 0; j < tokens.size(); ++j) {
+            const Token& tok = tokens[j];
+            putVarint(buf, tok.type);
+            putVarint(buf, tok.offset - prevEnd);
+            putVarint(buf, tok.length);
+            if (withLexemes && tok.symbol != NO_SYMBOL) {
+                uint32_t& id = lexemeOfSymbol[tok.symbol];
+                if (id == NO_SYMBOL) {
+                    id = table.intern(lexeme(tok));
+                }
+                putVarint(buf, id);
+            } else if (withLexemes) {
+                putVarint(buf, table.intern(lexeme(tok)));
+            }
+            prevEnd = tok.offset + tok.length;
+            if (buf.size() >= TOKFILE_WRITE_BLOCK) {
+                fout.write(buf.data(), buf.size());
+                written += buf.size();
+                buf.clear();
+            }
+        }
+        uint64_t errorsOffset = written + buf.size();
+        prevEnd = 0;
+        for (size_t j = 0; j < errors.size(); ++j) {
+            const LexError& err = errors[j];
+            putVarint(buf, err.kind);
+            putVarint(buf, err.offset - prevEnd);
+            putVarint(buf, err.length);
+            if (withLexemes) {
+                putVarint(buf, table.intern(errorText(err)));
+            }
+            prevEnd = err.offset + err.length;
+            if (buf.size() >= TOKFILE_WRITE_BLOCK) {
+                fout.write(buf.data(), buf.size());
+                written += buf.size();
+                buf.clear();
+            }
+        }
+        uint64_t tableOffset = 0;
+        if (withLexemes) {
+            tableOffset = written + buf.size();
+            for (uint32_t id = 0; id < table.size(); ++id) {
+                string_view text = table.text(id);
+                putVarint(buf, text.size());
+                buf.append(text.data(), text.size());
+                if (buf.size() >= TOKFILE_WRITE_BLOCK) {
+                    fout.write(buf.data(), buf.size());
+                    buf.clear();
+                }
+            }
+        }
+        fout.write(buf.data(), buf.size());
+        
+        char header[TOKFILE_HEADER_SIZE];
+        memcpy(header, TOKFILE_MAGIC, 4);
+        header[4] = (char)(TOKFILE_VERSION & 0xFF);
+        header[5] = (char)(TOKFILE_VERSION >> 8);
+        header[6] = (char)(withLexemes ? TOKFILE_LEXEMES : 0);
+        header[7] = 0;
+        putU64(header + 8, sourceCode.size());
+        putU64(header + 16, tokens.size());
+        putU64(header + 24, errors.size());
+        putU64(header + 32, errorsOffset);
+        putU64(header + 40, tableOffset);
+        putU64(header + 48, table.size());
+        fout.seekp(0);
+        fout.write(header, TOKFILE_HEADER_SIZE);
+        fout.close();
+        return !fout.fail();
+    }
+    
+    // Tokens and errors as one text block, as used by the combined output of
+    // the batch mode
+    void writeResults(ostream& out, const string& title) {
+        settleRecords();
+        out << "File: " << title << "\n";
+        for (size_t j = 0; j < tokens.size(); ++j) {
+            out << lexeme(tokens[j]) << " -> " << tokenTypeName(tokens[j].type) << "\n";
+        }
+        out << "Errors:\n";
+        for (size_t j = 0; j < errors.size(); ++j) {
+            writeError(out, errors[j]);
+            out << "\n";
+        }
+    }
+};
+
+// Reads a binary token file in place: the file is mapped and records are
+// decoded one at a time as a cursor moves over them.
+class TokenFileReader {
+private:
+    SourceBuffer file;
+    uint64_t nTokens;
+    uint64_t nErrors;
+    uint64_t nSource;
+    size_t errorsOffset;
+    size_t tableOffset;
+    bool hasLexemes;
+    vector<string_view> lexemes;
+    
+public:
+    // One decoded record; kind is a TokenType for tokens and an ErrorKind
+    // for errors, lexemeId is only set when the file has a lexeme table
+    struct Record {
+        uint8_t kind;
+        uint32_t offset;
+        uint32_t length;
+        uint32_t lexemeId;
+    };
+    
+    class Cursor {
+    private:
+        const unsigned char* p;
+        const unsigned char* end;
+        uint64_t remaining;
+        uint32_t prevEnd;
+        bool hasLexemes;
+        
+    public:
+        Cursor(const unsigned char* from, const unsigned char* to, uint64_t count, bool lexemes)
+            : p(from), end(to), remaining(count), prevEnd(0), hasLexemes(lexemes) {}
+        
+        bool next(Record& rec) {
+            if (remaining == 0) return false;
+            uint64_t kind, gap, len, id = 0;
+            if (!getVarint(p, end, kind) || !getVarint(p, end, gap) || !getVarint(p, end, len)
+                || (hasLexemes && !getVarint(p, end, id))) {
+                remaining = 0;
+                return false;
+            }
+            remaining--;
+            rec.kind = (uint8_t)kind;
+            rec.offset = prevEnd + (uint32_t)gap;
+            rec.length = (uint32_t)len;
+            rec.lexemeId = (uint32_t)id;
+            prevEnd = rec.offset + rec.length;
+            return true;
+        }
+    };
+    
+    TokenFileReader(): nTokens(0), nErrors(0), nSource(0), errorsOffset(0), tableOffset(0), hasLexemes(false) {}
+    
+    bool open(const string& filename) {
+        lexemes.clear();
+        if (!file.loadFile(filename) || file.size() < TOKFILE_HEADER_SIZE) return false;
+        const unsigned char* base = (const unsigned char*)file.data();
+        if (memcmp(base, TOKFILE_MAGIC, 4) != 0) return false;
+        if ((base[4] | base[5] << 8) != TOKFILE_VERSION) return false;
+        hasLexemes = (base[6] & TOKFILE_LEXEMES) != 0;
+        nSource = getU64(base + 8);
+        nTokens = getU64(base + 16);
+        nErrors = getU64(base + 24);
+        errorsOffset = (size_t)getU64(base + 32);
+        tableOffset = (size_t)getU64(base + 40);
+        uint64_t nLexemes = getU64(base + 48);
+        size_t tableEnd = hasLexemes ? tableOffset : file.size();
+        if (errorsOffset < TOKFILE_HEADER_SIZE || errorsOffset > tableEnd || tableEnd > file.size()) return false;
+        if (hasLexemes) {
+            // Every entry takes at least its length byte, so a count larger
+            // than the rest of the file is corrupt; don't reserve for it
+            if (nLexemes > file.size() - tableOffset) return false;
+            const unsigned char* p = base + tableOffset;
+            const unsigned char* end = base + file.size();
+            lexemes.reserve(nLexemes);
+            for (uint64_t k = 0; k < nLexemes; ++k) {
+                uint64_t len;
+                if (!getVarint(p, end, len) || len > (uint64_t)(end - p)) return false;
+                lexemes.push_back(string_view((const char*)p, len));
+                p += len;
+            }
+        }
+        return true;
+    }
+    
+    uint64_t tokenCount() const { return nTokens; }
+    uint64_t errorCount() const { return nErrors; }
+    uint64_t sourceSize() const { return nSource; }
+    bool lexemesIncluded() const { return hasLexemes; }
+    
+    Cursor tokens() const {
+        const unsigned char* base = (const unsigned char*)file.data();
+        return Cursor(base + TOKFILE_HEADER_SIZE, base + errorsOffset, nTokens, hasLexemes);
+    }
+    
+    Cursor errors() const {
+        const unsigned char* base = (const unsigned char*)file.data();
+        return Cursor(base + errorsOffset, base + (hasLexemes ? tableOffset : file.size()), nErrors, hasLexemes);
+    }
+    
+    string_view lexemeText(uint32_t id) const {
+        return id < lexemes.size() ? lexemes[id] : string_view();
+    }
+};
+
+// ---------------------------------------------------------------------------
+// Batch mode
+//
+//   main [--jobs N] [--combined FILE|-] [--binary [--no-lexemes]] [--top N]
+//        [--cache DIR [--cache-size N]] [-r DIR]... [FILE]...
+//   main --stream [--block-size N] [FILE|-]
+//   main --dump TOKENFILE
+//
+// Lexes many files at once. Every worker thread owns one LexicalAnalyzer that
+// is reused for all the files it picks up, so token and error storage keeps
+// its capacity from file to file. Workers take the next file from a shared
+// counter, which keeps them busy until the list is exhausted regardless of
+// file sizes. By default each input gets <input>.Token.txt and
+// <input>.Error.txt (or <input>.tokens.bin with --binary; --no-lexemes leaves
+// the lexeme table out of it, which is much faster to write); with --combined
+// all results go to one stream, one block per file in completion order.
+// --top N adds each file's N most frequent identifiers to the output (stdout
+// when writing per-file). Errors are written as their bare text unless
+// --error-positions asks for "line:column: text (kind)". --cache DIR keeps
+// the results in a ResultCache shared by all workers and by later runs, so
+// unchanged files are only hashed; --cache-size caps it (default 1G).
+// --stream lexes standard input (or one file) as it is read and prints each
+// token as soon as its block is lexed, errors on stderr. --dump prints a
+// binary token file as text and takes no other options.
+// ---------------------------------------------------------------------------
+
+// 1024, 64K, 10M, 1G
+static uint64_t parseByteSize(const string& text) {
+    char* end = NULL;
+    double v = strtod(text.c_str(), &end);
+    uint64_t scale = 1;
+    if (end && (*end == 'K' || *end == 'k')) scale = 1ull << 10;
+    if (end && (*end == 'M' || *end == 'm')) scale = 1ull << 20;
+    if (end && (*end == 'G' || *end == 'g')) scale = 1ull << 30;
+    return v > 0 ? (uint64_t)(v * scale) : 0;
+}
+
+struct BatchJob {
+    vector<string> files;
+    string combinedPath;        // empty: per-file output
+    ostream* combined;
+    mutex combinedLock;
+    atomic<size_t> nextFile;
+    atomic<size_t> totalTokens;
+    atomic<size_t> totalErrors;
+    atomic<size_t> typeTotals[NUM_TOKEN_TYPES];
+    atomic<size_t> failures;
+    unsigned jobs;
+    bool binary;
+    bool withLexemes;           // binary output only
+    size_t topIdentifiers;
+    bool collectStats;
+    LexStats stats;             // merged from the workers under combinedLock
+    RecoveryMode recovery;
+    size_t maxErrors;
+    bool errorPositions;
+    bool stream;
+    size_t blockSize;           // for --stream
+    const ResultCache* cache;   // --cache
+    
+    BatchJob(): combined(NULL), nextFile(0), totalTokens(0), totalErrors(0), failures(0), jobs(1), binary(false),
+                withLexemes(true), topIdentifiers(0), collectStats(false), recovery(RECOVER_NONE), maxErrors(0),
+                errorPositions(false), stream(false), blockSize(STREAM_BLOCK_SIZE), cache(NULL) {
+        for (int t = 0; t < NUM_TOKEN_TYPES; ++t) typeTotals[t] = 0;
+    }
+};
+
+static bool isBatchOutputFile(const string& path) {
+    const string suffixes[] = { ".Token.txt", ".Error.txt", ".tokens.bin" };
+    for (int k = 0; k < 3; ++k) {
+        if (path.size() >= suffixes[k].size()
+            && path.compare(path.size() - suffixes[k].size(), suffixes[k].size(), suffixes[k]) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void batchWorker(BatchJob* job) {
+    LexicalAnalyzer lexer;
+    lexer.setSymbolInterning(job->topIdentifiers != 0);
+    LexStats stats;
+    if (job->collectStats) {
+        lexer.setStats(&stats);
+    }
+    lexer.setErrorRecovery(job->recovery, job->maxErrors);
+    lexer.setErrorPositions(job->errorPositions);
+    lexer.setCache(job->cache);
+    ostringstream block;
+    while (true) {
+        size_t k = job->nextFile++;
+        if (k >= job->files.size()) {
+            lock_guard<mutex> guard(job->combinedLock);
+            job->stats.merge(stats);
+            break;
+        }
+        const string& path = job->files[k];
+        if (!lexer.loadFromFile(path)) {
+            cerr << "Failed to open file: " << path << endl;
+            job->failures++;
+            continue;
+        }
+        // A single input gets the threads to itself, unless it is profiled
+        if (job->files.size() == 1 && job->jobs > 1 && !job->collectStats) {
+            lexer.analyzeParallel(job->jobs);
+        } else {
+            lexer.analyze();
+        }
+        job->totalTokens += lexer.tokenCount();
+        job->totalErrors += lexer.errorCount();
+        for (int t = TOK_IDENTIFIER; t < NUM_TOKEN_TYPES; ++t) {
+            job->typeTotals[t] += lexer.tokenCountOf(t);
+        }
+        if (job->combined) {
+            block.str("");
+            lexer.writeResults(block, path);
+            if (job->topIdentifiers) {
+                lexer.printTopIdentifiers(block, job->topIdentifiers);
+            }
+            lock_guard<mutex> guard(job->combinedLock);
+            *job->combined << block.str();
+            continue;
+        }
+        if (job->topIdentifiers) {
+            block.str("");
+            block << "File: " << path << "\n";
+            lexer.printTopIdentifiers(block, job->topIdentifiers);
+            lock_guard<mutex> guard(job->combinedLock);
+            cout << block.str();
+        }
+        if (job->binary ? !lexer.exportBinary(path + ".tokens.bin", job->withLexemes)
+                        : !lexer.exportToFiles(path + ".Token.txt", path + ".Error.txt")) {
+            cerr << "Failed to write output for: " << path << endl;
+            job->failures++;
+        }
+    }
+}
+
+// Output of --stream: tokens go to stdout in the Token.txt layout, a block
+// at a time, errors to stderr as in Error.txt or with their position
+class StreamPrinter : public TokenSink {
+private:
+    string pending;
+    bool positions;
+    
+public:
+    size_t errors;
+    
+    explicit StreamPrinter(bool withPositions): positions(withPositions), errors(0) {}
+    
+    void onToken(const Token& tok, string_view lexeme) {
+        pending.append(lexeme);
+        pending += " -> ";
+        pending += tokenTypeName(tok.type);
+        pending += '\n';
+    }
+    
+    // analyzeStream() reports through onErrorAt(); this is only reached
+    // without a position
+    void onError(const LexError& err, string_view text) {
+        flush();
+        errors++;
+        if (positions) {
+            cerr << "@" << err.offset << ": ";
+        }
+        cerr << text << endl;
+    }
+    
+    void onErrorAt(const ErrorRecord& rec, string_view text) {
+        flush();
+        errors++;
+        if (positions) {
+            LexicalAnalyzer::writeError(cerr, rec, text);
+        } else {
+            cerr << text;
+        }
+        cerr << endl;
+    }
+    
+    void flush() {
+        cout << pending;
+        cout.flush();
+        pending.clear();
+    }
+};
+
+int runStream(const BatchJob& job) {
+#ifdef LEXER_HAVE_MMAP
+    if (job.files.size() > 1) {
+        cerr << "--stream reads one input" << endl;
+        return 1;
+    }
+    string path = job.files.empty() ? string("-") : job.files[0];
+    int fd = (path == "-") ? STDIN_FILENO : open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        cerr << "Failed to open file: " << path << endl;
+        return 1;
+    }
+    LexicalAnalyzer lexer;
+    lexer.setErrorRecovery(job.recovery, job.maxErrors);
+    StreamPrinter printer(job.errorPositions);
+    bool ok = lexer.analyzeStream(fd, &printer, job.blockSize);
+    if (fd != STDIN_FILENO) {
+        close(fd);
+    }
+    if (!ok) {
+        cerr << "Failed to read: " << path << endl;
+    }
+    size_t tokens = 0;
+    for (int t = TOK_IDENTIFIER; t < NUM_TOKEN_TYPES; ++t) {
+        tokens += lexer.tokenCountOf(t);
+    }
+    cerr << tokens << " tokens, " << printer.errors << " errors" << endl;
+    for (int t = TOK_IDENTIFIER; t < NUM_TOKEN_TYPES; ++t) {
+        cerr << (t == TOK_IDENTIFIER ? "  " : ", ") << tokenTypeName(t) << " " << lexer.tokenCountOf(t);
+    }
+    cerr << endl;
+    return ok ? 0 : 1;
+#else
+    (void)job;
+    cerr << "--stream is not supported on this platform" << endl;
+    return 1;
+#endif
+}
+
+// Print a binary token file in the text layout of the combined output.
+// The source is not part of the file, so errors are shown without their
+// line and column.
+int dumpTokenFile(const string& filename) {
+    TokenFileReader reader;
+    if (!reader.open(filename)) {
+        cerr << "Not a readable token file: " << filename << endl;
+        return 1;
+    }
+    string out;
+    TokenFileReader::Record rec;
+    TokenFileReader::Cursor tokens = reader.tokens();
+    while (tokens.next(rec)) {
+        if (reader.lexemesIncluded()) {
+            out.append(reader.lexemeText(rec.lexemeId));
+        } else {
+            out += "@" + to_string(rec.offset) + "+" + to_string(rec.length);
+        }
+        out += " -> ";
+        out += tokenTypeName(rec.kind);
+        out += '\n';
+    }
+    out += "Errors:\n";
+    TokenFileReader::Cursor errors = reader.errors();
+    while (errors.next(rec)) {
+        if (reader.lexemesIncluded()) {
+            out.append(reader.lexemeText(rec.lexemeId));
+        } else {
+            out += "@" + to_string(rec.offset) + "+" + to_string(rec.length);
+        }
+        if (rec.kind != ERR_UNTERMINATED_COMMENT && rec.kind != ERR_TOO_MANY_ERRORS) {
+            out += " (";
+            out += errorKindName(rec.kind);
+            out += ")";
+        }
+        out += '\n';
+    }
+    cout << out;
+    cout.flush();
+    return 0;
+}
+
+static void printBatchUsage() {
+    cerr << "Usage: main [--jobs N] [--combined FILE|-] [--binary [--no-lexemes]] [--top N] [--stats]" << endl;
+    cerr << "            [--recover] [--max-errors N] [--error-positions] [--cache DIR [--cache-size N]]" << endl;
+    cerr << "            [-r DIR]... [FILE]..." << endl;
+    cerr << "       main --stream [--block-size N] [--recover] [--max-errors N] [--error-positions] [FILE|-]" << endl;
+    cerr << "       main --dump TOKENFILE" << endl;
+    cerr << "       main            (interactive menu)" << endl;
+}
+
+int runBatch(int argc, char* argv[]) {
+    BatchJob job;
+    job.jobs = thread::hardware_concurrency();
+    string dumpPath;
+    string cacheDir;
+    uint64_t cacheLimit = CACHE_DEFAULT_LIMIT;
+    for (int a = 1; a < argc; ++a) {
+        string arg = argv[a];
+        if ((arg == "--jobs" || arg == "-j") && a + 1 < argc) {
+            job.jobs = (unsigned)atoi(argv[++a]);
+        } else if (arg == "--dump" && a + 1 < argc) {
+            dumpPath = argv[++a];
+        } else if (arg == "--binary") {
+            job.binary = true;
+        } else if (arg == "--no-lexemes") {
+            job.withLexemes = false;
+        } else if (arg == "--recover") {
+            job.recovery = RECOVER_SKIP_TO_DELIMITER;
+        } else if (arg == "--max-errors" && a + 1 < argc) {
+            job.maxErrors = (size_t)atol(argv[++a]);
+        } else if (arg == "--error-positions") {
+            job.errorPositions = true;
+        } else if (arg == "--cache" && a + 1 < argc) {
+            cacheDir = argv[++a];
+        } else if (arg == "--cache-size" && a + 1 < argc) {
+            cacheLimit = parseByteSize(argv[++a]);
+        } else if (arg == "--stream") {
+            job.stream = true;
+        } else if (arg == "--block-size" && a + 1 < argc) {
+            job.blockSize = max((size_t)parseByteSize(argv[++a]), (size_t)1);
+        } else if (arg == "--stats") {
+#ifndef LEXER_NO_STATS
+            job.collectStats = true;
+#else
+            cerr << "Statistics were compiled out (LEXER_NO_STATS)" << endl;
+#endif
+        } else if (arg == "--top" && a + 1 < argc) {
+            job.topIdentifiers = (size_t)atol(argv[++a]);
+        } else if (arg == "--combined" && a + 1 < argc) {
+            job.combinedPath = argv[++a];
+        } else if (arg == "-r" && a + 1 < argc) {
+            error_code ec;
+            filesystem::recursive_directory_iterator it(argv[++a], ec), end;
+            if (ec) {
+                cerr << "Cannot read directory: " << argv[a] << endl;
+                return 1;
+            }
+            for (; it != end; it.increment(ec)) {
+                if (it->is_regular_file(ec) && !isBatchOutputFile(it->path().string())) {
+                    job.files.push_back(it->path().string());
+                }
+            }
+        } else if (arg.size() > 1 && arg[0] == '-') {
+            printBatchUsage();
+            return 1;
+        } else {
+            job.files.push_back(arg);
+        }
+    }
+    if (!dumpPath.empty()) {
+        if (argc != 3) {
+            printBatchUsage();
+            return 1;
+        }
+        return dumpTokenFile(dumpPath);
+    }
+    if (job.stream) {
+        return runStream(job);
+    }
+    if (job.files.empty() || (!job.withLexemes && !job.binary)) {
+        printBatchUsage();
+        return 1;
+    }
+    if (job.jobs == 0) {
+        job.jobs = 1;
+    }
+    ResultCache cache;
+    if (!cacheDir.empty()) {
+        if (!cache.open(cacheDir, cacheLimit)) {
+            cerr << "Cannot use cache directory: " << cacheDir << endl;
+            return 1;
+        }
+        job.cache = &cache;
+    }
+    
+    ofstream combinedFile;
+    if (job.combinedPath == "-") {
+        job.combined = &cout;
+    } else if (!job.combinedPath.empty()) {
+        combinedFile.open(job.combinedPath.c_str());
+        if (!combinedFile) {
+            cerr << "Failed to write to file: " << job.combinedPath << endl;
+            return 1;
+        }
+        job.combined = &combinedFile;
+    }
+    
+    vector<thread> workers;
+    size_t nWorkers = min((size_t)job.jobs, job.files.size());
+    for (size_t w = 1; w < nWorkers; ++w) {
+        workers.push_back(thread(batchWorker, &job));
+    }
+    batchWorker(&job);
+    for (size_t w = 0; w < workers.size(); ++w) {
+        workers[w].join();
+    }
+    if (job.combined) {
+        job.combined->flush();
+    }
+    
+    cerr << job.files.size() << " files, " << job.totalTokens << " tokens, "
+         << job.totalErrors << " errors";
+    if (job.failures) {
+        cerr << ", " << job.failures << " failed";
+    }
+    cerr << endl;
+    for (int t = TOK_IDENTIFIER; t < NUM_TOKEN_TYPES; ++t) {
+        cerr << (t == TOK_IDENTIFIER ? "  " : ", ") << tokenTypeName(t) << " " << job.typeTotals[t];
+    }
+    cerr << endl;
+    if (job.collectStats) {
+        job.stats.print(cerr);
+    }
+    return job.failures ? 1 : 0;
+}
+
+// ---------------------------------------------------------------------------
+// Keyword lookup microbenchmark (run with --bench-keywords)
+// ---------------------------------------------------------------------------
+
+// The original isKeyword(): builds the keyword strings on every call and
+// compares them one by one. Kept only as the benchmark baseline; the words
+// come from keywordList so the two lookups cannot disagree.
+static bool legacyIsKeyword(const string& str) {
+    for (int i = 0; i < NUM_KEYWORDS; ++i) {
+        if (str == string(keywordList[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void benchmarkKeywords() {
+    // Identifier-shaped words as they reach the keyword check: roughly a
+    // third keywords, the rest ordinary names, near misses and long words.
+    const char* keywordWords[] = {
+        "int", "if", "return", "for", "while", "agar", "magar", "void",
+        "const", "else", "char", "struct", "loop", "true", "false", "namespace"
+    };
+    const char* otherWords[] = {
+        "i", "j", "x", "n", "tmp", "count", "value", "result", "index", "data",
+        "size", "len", "buffer", "node", "next", "main", "printf", "invalidID",
+        "total", "sum", "whilex", "retur", "ints", "Int", "loops", "magic",
+        "constant", "structure", "calculateTotalAmount", "getValue", "x1", "e10"
+    };
+    const int nKeywordWords = sizeof(keywordWords) / sizeof(keywordWords[0]);
+    const int nOtherWords = sizeof(otherWords) / sizeof(otherWords[0]);
+    const int N = 1 << 20;
+    
+    vector<string> words;
+    words.reserve(N);
+    uint32_t rng = 12345;
+    for (int k = 0; k < N; ++k) {
+        rng = rng * 1103515245u + 12345u;
+        uint32_t r = rng >> 8;
+        if (r % 3 == 0) {
+            words.push_back(keywordWords[(r / 3) % nKeywordWords]);
+        } else {
+            words.push_back(otherWords[(r / 3) % nOtherWords]);
+        }
+    }
+    
+    chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+    int legacyHits = 0;
+    for (int k = 0; k < N; ++k) {
+        legacyHits += legacyIsKeyword(words[k]);
+    }
+    chrono::steady_clock::time_point t1 = chrono::steady_clock::now();
+    int hashHits = 0;
+    for (int rep = 0; rep < 16; ++rep) {
+        for (int k = 0; k < N; ++k) {
+            hashHits += lookupKeyword(words[k]);
+        }
+    }
+    chrono::steady_clock::time_point t2 = chrono::steady_clock::now();
+    hashHits /= 16;
+    
+    double legacyNs = chrono::duration<double, nano>(t1 - t0).count() / N;
+    double hashNs = chrono::duration<double, nano>(t2 - t1).count() / (16.0 * N);
+    cout << "Keyword lookup benchmark (" << N << " words, " << legacyHits << " keywords)" << endl;
+    cout << "  linear list:  " << legacyNs << " ns/lookup" << endl;
+    cout << "  perfect hash: " << hashNs << " ns/lookup" << endl;
+    if (legacyHits != hashHits) {
+        cout << "  MISMATCH: perfect hash found " << hashHits << " keywords" << endl;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Benchmark suite
+//
+//   main --gen-corpus FILE [--size N] [--mix SPEC] [--comment-length N] [--seed N]
+//   main --bench [--input FILE | --size N --mix SPEC ...] [--iterations N]
+//                [--threads N] [--json FILE]
+//
+// The generator writes a synthetic source of the given size (suffix K, M or
+// G) from a weighted token mix, e.g. "ident=40,number=10,blockcomment=5";
+// unnamed kinds keep their default weight. The benchmark times
+// loadFromFile() plus paging the input in, analyze() (and analyzeParallel()
+// with --threads), exportToFiles() and exportBinary() separately and reports
+// MB/s, tokens/s and peak RSS as JSON for regression tracking. Exports go to
+// a fresh directory under the system temp directory. Each phase reuses one
+// analyzer; times are the best of the iterations.
+//
+// Heap allocation counts need the global operator new replaced, which costs
+// two atomic adds per allocation, so they are only compiled into builds
+// with -DLEXER_COUNT_ALLOCS ("make bench" builds main_bench that way). They
+// are those of the last (steady-state) iteration.
+// ---------------------------------------------------------------------------
+
+// Global allocation counters, read by the benchmark; they stay zero
+// unless LEXER_COUNT_ALLOCS is defined
+static atomic<uint64_t> heapAllocCount(0);
+static atomic<uint64_t> heapAllocBytes(0);
+
+#ifdef LEXER_COUNT_ALLOCS
+void* operator new(size_t size) {
+    heapAllocCount.fetch_add(1, memory_order_relaxed);
+    heapAllocBytes.fetch_add(size, memory_order_relaxed);
+    void* p = malloc(size ? size : 1);
+    if (!p) throw bad_alloc();
+    return p;
+}
+void* operator new[](size_t size) { return operator new(size); }
+// Kept out of line so the compiler does not pair the inlined free() with
+// the operator new it sees at the call site (-Wmismatched-new-delete)
+#if defined(__GNUC__)
+#define LEXER_NOINLINE __attribute__((noinline))
+#else
+#define LEXER_NOINLINE
+#endif
+LEXER_NOINLINE void operator delete(void* p) noexcept { free(p); }
+LEXER_NOINLINE void operator delete[](void* p) noexcept { free(p); }
+LEXER_NOINLINE void operator delete(void* p, size_t) noexcept { free(p); }
+LEXER_NOINLINE void operator delete[](void* p, size_t) noexcept { free(p); }
+#endif
+
+enum CorpusPiece {
+    MIX_IDENT,          // identifier with underscore
+    MIX_WORD,           // identifier-shaped without underscore (error)
+    MIX_KEYWORD,
+    MIX_NUMBER,
+    MIX_OPERATOR,
+    MIX_PUNCT,
+    MIX_LINE_COMMENT,
+    MIX_BLOCK_COMMENT,
+    NUM_MIX_PIECES
+};
+
+const char* const mixPieceNames[NUM_MIX_PIECES] = {
+    "ident", "word", "keyword", "number", "operator", "punct", "linecomment", "blockcomment"
+};
+
+struct CorpusSpec {
+    uint64_t size;
+    int weights[NUM_MIX_PIECES];
+    int commentLength;
+    uint32_t seed;
+    
+    CorpusSpec(): size(1 << 20), commentLength(80), seed(1) {
+        const int defaults[NUM_MIX_PIECES] = { 30, 5, 10, 15, 20, 15, 3, 2 };
+        memcpy(weights, defaults, sizeof(weights));
+    }
+    
+    // "ident=40,number=10,..."
+    bool parseMix(const string& spec) {
+        stringstream in(spec);
+        string item;
+        while (getline(in, item, ',')) {
+            size_t eq = item.find('=');
+            if (eq == string::npos) return false;
+            string name = item.substr(0, eq);
+            int k = 0;
+            while (k < NUM_MIX_PIECES && name != mixPieceNames[k]) k++;
+            if (k == NUM_MIX_PIECES) return false;
+            weights[k] = max(0, atoi(item.c_str() + eq + 1));
+        }
+        return true;
+    }
+    
+    string mixString() const {
+        string out;
+        for (int k = 0; k < NUM_MIX_PIECES; ++k) {
+            if (k) out += ",";
+            out += string(mixPieceNames[k]) + "=" + to_string(weights[k]);
+        }
+        return out;
+    }
+};
+
+class CorpusGenerator {
+private:
+    const CorpusSpec& spec;
+    uint64_t rng;
+    int totalWeight;
+    int onLine;                 // pieces on the current line
+    
+    uint32_t next() {
+        rng ^= rng << 13;
+        rng ^= rng >> 7;
+        rng ^= rng << 17;
+        return (uint32_t)(rng >> 16);
+    }
+    
+    void letters(string& out, int n) {
+        static const char alnum[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+        for (int k = 0; k < n; ++k) {
+            out.push_back(alnum[next() % (k == 0 ? 52 : 62)]);
+        }
+    }
+    
+    void digits(string& out, int n) {
+        for (int k = 0; k < n; ++k) out.push_back((char)('0' + next() % 10));
+    }
+    
+    void piece(string& out, int kind) {
+        static const char* const operators[] = {
+            "=:=", "==", "!=", "<>", "=+", "=>", "=<", "++", "--", "&&", "||",
+            ">>", "::", "+", "-", "*", "/", "%", ":"
+        };
+        static const char* const punct[] = { "{", "}", "(", ")", "[", "]", ";", ",", "<", ">" };
+        switch (kind) {
+            case MIX_IDENT:
+                if (next() % 2) out.push_back('_');
+                letters(out, 2 + next() % 8);
+                out.push_back('_');
+                letters(out, next() % 6);
+                break;
+            case MIX_WORD:
+                letters(out, 1 + next() % 10);
+                break;
+            case MIX_KEYWORD:
+                out.append(keywordList[next() % NUM_KEYWORDS]);
+                break;
+            case MIX_NUMBER:
+                if (next() % 8 == 0) out.push_back(next() % 2 ? '-' : '+');
+                digits(out, 1 + next() % 5);
+                if (next() % 2) {
+                    out.push_back('.');
+                    digits(out, 1 + next() % 4);
+                }
+                if (next() % 4 == 0) {
+                    out.push_back(next() % 2 ? 'E' : 'e');
+                    if (next() % 2) out.push_back(next() % 2 ? '+' : '-');
+                    digits(out, 1 + next() % 2);
+                }
+                break;
+            case MIX_OPERATOR:
+                out.append(operators[next() % (sizeof(operators) / sizeof(operators[0]))]);
+                break;
+            case MIX_PUNCT:
+                out.append(punct[next() % (sizeof(punct) / sizeof(punct[0]))]);
+                break;
+            case MIX_LINE_COMMENT:
+                out.append("// ");
+                for (int k = 0; k < spec.commentLength; k += 8) {
+                    letters(out, 7);
+                    out.push_back(' ');
+                }
+                out.push_back('\n');
+                break;
+            case MIX_BLOCK_COMMENT:
+                out.append("/* ");
+                for (int k = 0; k < spec.commentLength; k += 8) {
+                    letters(out, 7);
+                    out.push_back(next() % 8 == 0 ? '\n' : ' ');
+                }
+                out.append("*/");
+                break;
+        }
+    }
+    
+    // One piece of the mix and the space or line break after it
+    void addPiece(string& out) {
+        int pick = next() % totalWeight;
+        int kind = 0;
+        while (pick >= spec.weights[kind]) pick -= spec.weights[kind++];
+        piece(out, kind);
+        if (++onLine >= 8 || kind == MIX_LINE_COMMENT) {
+            out.append(onLine >= 8 ? "\n    " : "    ");
+            onLine = 0;
+        } else {
+            out.push_back(' ');
+        }
+    }
+    
+public:
+    CorpusGenerator(const CorpusSpec& s): spec(s), rng(0x9E3779B97F4A7C15ull ^ s.seed), totalWeight(0), onLine(0) {
+        for (int k = 0; k < NUM_MIX_PIECES; ++k) totalWeight += spec.weights[k];
+    }
+    
+    bool write(const string& filename) {
+        ofstream fout(filename.c_str(), ios::binary);
+        if (!fout || totalWeight <= 0) return false;
+        string buf;
+        buf.reserve(TOKFILE_WRITE_BLOCK + 4096);
+        uint64_t written = 0;
+        while (written + buf.size() < spec.size) {
+            addPiece(buf);
+            if (buf.size() >= TOKFILE_WRITE_BLOCK) {
+                fout.write(buf.data(), buf.size());
+                written += buf.size();
+                buf.clear();
+            }
+        }
+        buf.resize(min<uint64_t>(buf.size(), spec.size - written));
+        fout.write(buf.data(), buf.size());
+        return !fout.fail();
+    }
+    
+    // The same text in memory, for small sizes
+    string text() {
+        string out;
+        while (totalWeight > 0 && out.size() < spec.size) {
+            addPiece(out);
+        }
+        out.resize(min<uint64_t>(out.size(), spec.size));
+        return out;
+    }
 };
 
-class LexicalAnalyzer {
-private:
-    string sourceCode;
-    Token tokens[MAX_TOKENS];
-    int tokenCount;
-    string errors[MAX_ERRORS];
-    int errorCount;
-    
-    bool isKeyword(const string& str) {
-        // List of keywords as per specification
-        string keywordList[] = {
-            "loop", "agar", "magar", "asm", "else", "new", "this", "auto",
-            "enum", "operator", "throw", "bool", "explicit", "private", "true",
-            "break", "export", "protected", "try", "case", "extern", "public",
-            "typedef", "catch", "false", "register", "typeid", "char", "float",
-            "typename", "class", "for", "return", "union", "const", "friend",
-            "short", "unsigned", "goto", "signed", "using", "continue", "if",
-            "sizeof", "virtual", "default", "inline", "static", "void", "delete",
-            "int", "volatile", "do", "long", "struct", "double", "mutable",
-            "switch", "while", "namespace"
-        };
-        int nKeywords = sizeof(keywordList) / sizeof(keywordList[0]);
-        for (int i = 0; i < nKeywords; ++i) {
-            if (str == keywordList[i]) {
-                return true;
+struct PhaseResult {
+    double seconds;
+    uint64_t allocations;
+    uint64_t allocBytes;
+    
+    PhaseResult(): seconds(1e300), allocations(0), allocBytes(0) {}
+};
+
+// Run f, keeping the best time and the allocations of this run
+template <class F>
+static void timePhase(PhaseResult& result, F f) {
+    uint64_t a0 = heapAllocCount.load(), b0 = heapAllocBytes.load();
+    chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+    f();
+    double secs = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+    result.seconds = min(result.seconds, secs);
+    result.allocations = heapAllocCount.load() - a0;
+    result.allocBytes = heapAllocBytes.load() - b0;
+}
+
+static long peakRssKb() {
+#ifdef LEXER_HAVE_MMAP
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) != 0) return -1;
+#ifdef __APPLE__
+    return ru.ru_maxrss / 1024;
+#else
+    return ru.ru_maxrss;
+#endif
+#else
+    return -1;
+#endif
+}
+
+static void phaseJson(ostream& out, const char* name, const PhaseResult& r, uint64_t bytes, uint64_t tokens, bool last) {
+    out << "    \"" << name << "\": {\"seconds\": " << r.seconds
+        << ", \"mb_per_s\": " << (bytes / 1048576.0) / r.seconds;
+    if (tokens) {
+        out << ", \"tokens_per_s\": " << tokens / r.seconds;
+    }
+#ifdef LEXER_COUNT_ALLOCS
+    out << ", \"allocations\": " << r.allocations
+        << ", \"alloc_bytes\": " << r.allocBytes;
+#endif
+    out << "}" << (last ? "\n" : ",\n");
+}
+
+static string jsonString(string_view text) {
+    string out = "\"";
+    for (size_t k = 0; k < text.size(); ++k) {
+        unsigned char c = (unsigned char)text[k];
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += (char)c;
+        } else if (c < 0x20) {
+            static const char hex[] = "0123456789abcdef";
+            out += "\\u00";
+            out += hex[c >> 4];
+            out += hex[c & 15];
+        } else {
+            out += (char)c;
+        }
+    }
+    return out + "\"";
+}
+
+// A new, empty directory under the system temp directory for the files the
+// benchmark or the self-test writes; empty on failure
+static filesystem::path makeTempDirectory(const char* prefix) {
+    error_code ec;
+    filesystem::path base = filesystem::temp_directory_path(ec);
+    if (ec) return filesystem::path();
+    random_device rd;
+    for (int attempt = 0; attempt < 16; ++attempt) {
+        ostringstream name;
+        name << prefix << hex << rd() << rd();
+        filesystem::path dir = base / name.str();
+        if (filesystem::create_directory(dir, ec)) return dir;
+    }
+    return filesystem::path();
+}
+
+// Read one byte per page so the whole input is resident
+static uint64_t touchPages(string_view text) {
+    uint64_t sum = 0;
+    for (size_t k = 0; k < text.size(); k += 4096) {
+        sum += (unsigned char)text[k];
+    }
+    return sum;
+}
+
+static void printBenchUsage() {
+    cerr << "Usage: main --gen-corpus FILE [--size N] [--mix SPEC] [--comment-length N] [--seed N]" << endl;
+    cerr << "       main --bench [--input FILE] [--size N] [--mix SPEC] [--comment-length N] [--seed N]" << endl;
+    cerr << "                    [--iterations N] [--threads N] [--json FILE]" << endl;
+    cerr << "Mix kinds:";
+    for (int k = 0; k < NUM_MIX_PIECES; ++k) cerr << " " << mixPieceNames[k];
+    cerr << endl;
+}
+
+int runBenchmark(int argc, char* argv[]) {
+    CorpusSpec spec;
+    string corpusOut, input, jsonPath;
+    int iterations = 3;
+    unsigned threads = 0;
+    bool bench = false;
+    for (int a = 1; a < argc; ++a) {
+        string arg = argv[a];
+        bool hasValue = a + 1 < argc;
+        if (arg == "--bench") {
+            bench = true;
+        } else if (arg == "--gen-corpus" && hasValue) {
+            corpusOut = argv[++a];
+        } else if (arg == "--size" && hasValue) {
+            spec.size = parseByteSize(argv[++a]);
+        } else if (arg == "--mix" && hasValue) {
+            if (!spec.parseMix(argv[++a])) {
+                printBenchUsage();
+                return 1;
             }
+        } else if (arg == "--comment-length" && hasValue) {
+            spec.commentLength = max(1, atoi(argv[++a]));
+        } else if (arg == "--seed" && hasValue) {
+            spec.seed = (uint32_t)atol(argv[++a]);
+        } else if (arg == "--input" && hasValue) {
+            input = argv[++a];
+        } else if (arg == "--iterations" && hasValue) {
+            iterations = max(1, atoi(argv[++a]));
+        } else if (arg == "--threads" && hasValue) {
+            threads = (unsigned)atoi(argv[++a]);
+        } else if (arg == "--json" && hasValue) {
+            jsonPath = argv[++a];
+        } else {
+            printBenchUsage();
+            return 1;
+        }
+    }
+    
+    if (!bench) {
+        if (!CorpusGenerator(spec).write(corpusOut)) {
+            cerr << "Failed to write corpus: " << corpusOut << endl;
+            return 1;
+        }
+        return 0;
+    }
+    
+    filesystem::path dir = makeTempDirectory("lexer-bench-");
+    if (dir.empty()) {
+        cerr << "Cannot create a temporary directory for the benchmark" << endl;
+        return 1;
+    }
+    const string tokenPath = (dir / "Token.txt").string();
+    const string errorPath = (dir / "Error.txt").string();
+    const string binaryPath = (dir / "tokens.bin").string();
+    bool generated = input.empty();
+    if (generated) {
+        input = (dir / "corpus.txt").string();
+        if (!CorpusGenerator(spec).write(input)) {
+            cerr << "Failed to write corpus: " << input << endl;
+            error_code ec;
+            filesystem::remove_all(dir, ec);
+            return 1;
         }
-        return false;
     }
     
-    void addToken(const string& lex, const string& type) {
-        if (tokenCount < MAX_TOKENS) {
-            tokens[tokenCount].lexeme = lex;
-            tokens[tokenCount].type = type;
-            tokenCount++;
+    LexicalAnalyzer lexer, puller;
+    PhaseResult load, analyze, pull, parallel, exportText, exportBin;
+    bool ok = puller.loadFromFile(input);
+    for (int it = 0; it < iterations && ok; ++it) {
+        // a mapped file is only read in by the first pass over it
+        volatile uint64_t touched = 0;
+        timePhase(load, [&]() {
+            ok = lexer.loadFromFile(input);
+            touched = touched + touchPages(lexer.source());
+        });
+        if (!ok) break;
+        timePhase(analyze, [&]() { lexer.analyze(); });
+        // the whole input through the pull interface, one token at a time
+        timePhase(pull, [&]() {
+            LexicalAnalyzer::TokenStream in = puller.tokenStream();
+            Token tok;
+            while (in.next(tok)) {}
+        });
+        if (threads) {
+            timePhase(parallel, [&]() { lexer.analyzeParallel(threads); });
         }
+        timePhase(exportText, [&]() { ok = lexer.exportToFiles(tokenPath, errorPath); });
+        timePhase(exportBin, [&]() { ok = ok && lexer.exportBinary(binaryPath); });
+    }
+    if (!ok) {
+        cerr << "Benchmark failed on: " << input << endl;
+    }
+    error_code ec;
+    filesystem::remove_all(dir, ec);
+    if (!ok) {
+        return 1;
+    }
+    
+    uint64_t bytes = lexer.sourceSize();
+    uint64_t tokens = lexer.tokenCount();
+    ostringstream json;
+    json << "{\n";
+    json << "  \"input\": {\"file\": " << jsonString(generated ? string("(generated)") : input)
+         << ", \"bytes\": " << bytes << ", \"tokens\": " << tokens
+         << ", \"errors\": " << lexer.errorCount();
+    if (generated) {
+        json << ", \"mix\": \"" << spec.mixString() << "\", \"comment_length\": " << spec.commentLength
+             << ", \"seed\": " << spec.seed;
+    }
+    json << "},\n";
+    json << "  \"scan_kernels\": \"" << runKernels.name << "\",\n";
+    json << "  \"iterations\": " << iterations << ",\n";
+    json << "  \"phases\": {\n";
+    phaseJson(json, "load", load, bytes, 0, false);
+    phaseJson(json, "analyze", analyze, bytes, tokens, false);
+    phaseJson(json, "pull", pull, bytes, tokens, false);
+    if (threads) {
+        phaseJson(json, "analyze_parallel", parallel, bytes, tokens, false);
     }
+    phaseJson(json, "export_text", exportText, bytes, tokens, false);
+    phaseJson(json, "export_binary", exportBin, bytes, tokens, true);
+    json << "  },\n";
+    json << "  \"peak_rss_kb\": " << peakRssKb() << "\n";
+    json << "}\n";
     
-    void addError(const string& lex) {
-        if (errorCount < MAX_ERRORS) {
-            errors[errorCount++] = lex;
+    if (jsonPath.empty()) {
+        cout << json.str();
+    } else {
+        ofstream fout(jsonPath.c_str());
+        fout << json.str();
+        if (!fout) {
+            cerr << "Failed to write to file: " << jsonPath << endl;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Self-test
+//
+//   main --selftest [--rounds N] [--seed N]
+//
+// Run from the repository root. Every golden input (sample_test.txt and the
+// fuzzed corpus in tests/fuzz) is loaded, analyzed and exported, and the
+// Token.txt and Error.txt written are compared byte for byte with the ones
+// the original hand-written scanner wrote for it, kept next to the input
+// (tests/make_golden.py); so is what analyze() hands to a sink.
+//
+// Then random rounds check everything documented to give the results of a
+// plain analyze() against it: analyzeParallel(), applyEdit(), the pull
+// interface, analyze() with statistics attached, analyze() into a sink,
+// analyzeStream() at several block sizes and a ResultCache round trip, with
+// symbol interning on and off and under each error recovery policy. Inputs
+// are CorpusGenerator output with random mixes and random soup of the bytes
+// the scanner treats specially; every tenth round is large enough for
+// analyzeParallel() to split it. The first mismatch is printed with the seed
+// and round that reproduce it. "make check" runs it.
+// ---------------------------------------------------------------------------
+
+static bool readWholeFile(const filesystem::path& path, string& text) {
+    ifstream fin(path, ios::binary);
+    if (!fin) return false;
+    ostringstream buf;
+    buf << fin.rdbuf();
+    text = buf.str();
+    return true;
+}
+
+// An input and the path of its golden files without ".Token.txt"
+struct GoldenCase {
+    filesystem::path input;
+    filesystem::path stem;
+};
+
+// How much of the symbol information a description includes
+enum SymbolDetail {
+    SYMBOLS_NONE,       // streamed results have none
+    SYMBOLS_BY_NAME,    // names and counts; ids may differ after edits
+    SYMBOLS_BY_ID       // the numbering of analyze() as well
+};
+
+static void describeToken(ostream& out, const Token& tok, string_view lexeme) {
+    out << "token " << (int)tok.type << " " << tok.offset << " " << tok.length << " " << lexeme;
+}
+
+static void describeError(ostream& out, const ErrorRecord& rec, string_view text) {
+    out << "error " << (int)rec.kind << " " << rec.offset << " " << rec.length << " " << rec.line << ":"
+        << rec.column << " " << text << "\n";
+}
+
+static void describeCounts(ostream& out, const LexicalAnalyzer& lexer) {
+    for (int t = TOK_IDENTIFIER; t < NUM_TOKEN_TYPES; ++t) {
+        out << "count " << t << " " << lexer.tokenCountOf(t) << "\n";
+    }
+}
+
+// The results of lexer (or the tokens pulled from it) as text, one line
+// per record, for comparing two ways of getting them
+static string describeResults(const LexicalAnalyzer& lexer, SymbolDetail detail, const vector<Token>* pulled = NULL) {
+    ostringstream out;
+    const SymbolTable& symbols = lexer.symbolTable();
+    size_t count = pulled ? pulled->size() : lexer.tokenCount();
+    for (size_t j = 0; j < count; ++j) {
+        Token tok = pulled ? (*pulled)[j] : lexer.tokenAt(j);
+        describeToken(out, tok, lexer.lexeme(tok));
+        if (detail == SYMBOLS_BY_ID) {
+            out << " #" << tok.symbol;
+        }
+        if (detail != SYMBOLS_NONE && tok.symbol != NO_SYMBOL) {
+            out << " " << (tok.symbol < symbols.size() ? symbols.name(tok.symbol) : string_view("(bad id)"));
         }
+        out << "\n";
+    }
+    for (size_t j = 0; j < lexer.errorCount(); ++j) {
+        ErrorRecord rec = lexer.errorAt(j);
+        describeError(out, rec, LexicalAnalyzer::errorText(rec.kind, lexer.source().substr(rec.offset, rec.length)));
+    }
+    describeCounts(out, lexer);
+    if (detail == SYMBOLS_NONE) {
+        return out.str();
+    }
+    vector<pair<string_view, uint32_t> > used;
+    for (uint32_t id = 0; id < symbols.size(); ++id) {
+        if (symbols.count(id) > 0) used.push_back(make_pair(symbols.name(id), symbols.count(id)));
+    }
+    sort(used.begin(), used.end());
+    for (size_t k = 0; k < used.size(); ++k) {
+        out << "symbol " << used[k].first << " " << used[k].second << "\n";
+    }
+    return out.str();
+}
+
+// Writes what analyze() hands to a sink in the format of Token.txt and
+// Error.txt
+class SelfTestSink : public TokenSink {
+private:
+    ostringstream tokens;
+    ostringstream errors;
+    
+public:
+    void onToken(const Token& tok, string_view lexeme) {
+        tokens << lexeme << " -> " << tokenTypeName(tok.type) << "\n";
     }
     
+    void onError(const LexError&, string_view text) {
+        errors << text << "\n";
+    }
+    
+    string tokenText() const { return tokens.str(); }
+    string errorText() const { return errors.str(); }
+};
+
+// Records what analyze() or analyzeStream() hands to a sink, in the form
+// of describeResults(..., SYMBOLS_NONE) without the counts
+class DescribingSink : public TokenSink {
+private:
+    const LexicalAnalyzer* lexer;   // resolves the positions of onError()
+    ostringstream tokens;
+    ostringstream errors;
+    
 public:
-    LexicalAnalyzer(): tokenCount(0), errorCount(0) {}
+    explicit DescribingSink(const LexicalAnalyzer* owner): lexer(owner) {}
     
-    bool loadFromFile(const string& filename) {
-        ifstream fin(filename.c_str());
-        if (!fin) {
+    void onToken(const Token& tok, string_view lexeme) {
+        describeToken(tokens, tok, lexeme);
+        tokens << "\n";
+    }
+    
+    void onError(const LexError& err, string_view text) {
+        describeError(errors, lexer->errorRecord(err), text);
+    }
+    
+    void onErrorAt(const ErrorRecord& rec, string_view text) {
+        describeError(errors, rec, text);
+    }
+    
+    string str() const { return tokens.str() + errors.str(); }
+};
+
+struct SelfTestPolicy {
+    RecoveryMode recovery;
+    size_t maxErrors;
+};
+
+const SelfTestPolicy selfTestPolicies[] = {
+    { RECOVER_NONE, 0 }, { RECOVER_SKIP_TO_DELIMITER, 0 }, { RECOVER_NONE, 3 }, { RECOVER_SKIP_TO_DELIMITER, 5 }
+};
+
+class SelfTest {
+private:
+    uint32_t seed;
+    int round;
+    mt19937 rng;
+    filesystem::path workDir;   // exports go here
+    string context;             // what the current check runs on, for the report
+    
+    static string lineAround(const string& text, size_t k) {
+        size_t from = text.rfind('\n', k == 0 ? 0 : k - 1);
+        from = (from == string::npos || k == 0) ? 0 : from + 1;
+        size_t to = text.find('\n', k);
+        return text.substr(from, (to == string::npos ? text.size() : to) - from);
+    }
+    
+    bool same(const string& what, const string& expected, const string& got) {
+        if (expected == got) return true;
+        size_t k = 0, line = 1;
+        while (k < expected.size() && k < got.size() && expected[k] == got[k]) {
+            if (expected[k] == '\n') line++;
+            k++;
+        }
+        cerr << "selftest: " << what << " (" << context << "), line " << line << endl;
+        cerr << "  expected: " << lineAround(expected, k) << endl;
+        cerr << "  got:      " << lineAround(got, k) << endl;
+        return false;
+    }
+    
+    bool checkGolden(const GoldenCase& golden) {
+        context = golden.input.string();
+        const char* const names[] = { ".Token.txt", ".Error.txt" };
+        string expected[2];
+        for (int f = 0; f < 2; ++f) {
+            if (!readWholeFile(golden.stem.string() + names[f], expected[f])) {
+                cerr << "selftest: cannot read " << golden.stem.string() << names[f] << endl;
+                return false;
+            }
+        }
+        LexicalAnalyzer lexer;
+        if (!lexer.loadFromFile(golden.input.string())) {
+            cerr << "selftest: cannot read " << golden.input.string() << endl;
             return false;
         }
-        sourceCode.clear();
-        string line;
-        while (getline(fin, line)) {
-            sourceCode += line;
-            sourceCode.push_back('\n');  // keep newlines
+        lexer.analyze();
+        const filesystem::path written[] = { workDir / "Token.txt", workDir / "Error.txt" };
+        if (!lexer.exportToFiles(written[0].string(), written[1].string())) {
+            cerr << "selftest: cannot write to " << workDir.string() << endl;
+            return false;
         }
-        fin.close();
-        return true;
+        for (int f = 0; f < 2; ++f) {
+            string got;
+            if (!readWholeFile(written[f], got)) {
+                cerr << "selftest: cannot read " << written[f].string() << endl;
+                return false;
+            }
+            if (!same(string(names[f] + 1) + " differs from the old scanner's", expected[f], got)) return false;
+        }
+        
+        // exportBinary() looks lexemes up by symbol id when interning is on;
+        // the file must come out the same
+        string binary[2];
+        for (int intern = 0; intern < 2; ++intern) {
+            lexer.setSymbolInterning(intern != 0);
+            lexer.analyze();
+            filesystem::path file = workDir / "tokens.bin";
+            if (!lexer.exportBinary(file.string()) || !readWholeFile(file, binary[intern])) {
+                cerr << "selftest: cannot write " << file.string() << endl;
+                return false;
+            }
+        }
+        if (!same("exportBinary() with interning differs from without", binary[0], binary[1])) return false;
+        
+        SelfTestSink sink;
+        lexer.analyze(&sink);
+        return same("analyze() into a sink differs from the old scanner's Token.txt", expected[0], sink.tokenText())
+            && same("analyze() into a sink differs from the old scanner's Error.txt", expected[1], sink.errorText());
     }
     
-    void setSourceCode(const string& src) {
-        sourceCode = src;
+    size_t below(size_t n) { return n ? rng() % n : 0; }
+    
+    // CorpusGenerator output with a random mix, or random soup of the bytes
+    // the scanner treats specially. Large soup is left without newlines half
+    // of the time, so that the chunk starts of analyzeParallel() fall inside
+    // tokens.
+    string randomInput(bool large) {
+        if (below(2) == 0) {
+            CorpusSpec spec;
+            spec.size = large ? (1 << 20) + below(1 << 20) : below(8192);
+            for (int k = 0; k < NUM_MIX_PIECES; ++k) {
+                spec.weights[k] = below(3) ? (int)below(40) : 0;
+            }
+            spec.weights[below(NUM_MIX_PIECES)] += 1;
+            spec.commentLength = 1 + below(large ? 20000 : 300);
+            spec.seed = rng();
+            return CorpusGenerator(spec).text();
+        }
+        static const char soup[] = "ab_xyzE1290.+-=:!&|<>/*;,(){}[] \t\"#\x80\n";
+        size_t kinds = sizeof(soup) - (large && below(2) == 0 ? 2 : 1);
+        string text(large ? (1 << 20) + below(1 << 20) : below(3000), ' ');
+        for (size_t k = 0; k < text.size(); ++k) {
+            text[k] = soup[below(kinds)];
+        }
+        return text;
     }
     
-    void analyze() {
-        tokenCount = 0;
-        errorCount = 0;
-        int n = sourceCode.size();
-        int i = 0;
-        
-        while (i < n) {
-            char c = sourceCode[i];
-            // 1. Skip whitespace
-            if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
-                i++;
-                continue;
+    void configure(LexicalAnalyzer& lexer, const SelfTestPolicy& policy, bool intern) {
+        lexer.setErrorRecovery(policy.recovery, policy.maxErrors);
+        lexer.setSymbolInterning(intern);
+    }
+    
+    // Repeated runs on one analyzer, which reuse the storage of the run
+    // before unless a memory limit of 0 makes them give it all back
+    bool checkParallel(const string& text, const SelfTestPolicy& policy, bool intern, const string& expected) {
+        LexicalAnalyzer lexer;
+        configure(lexer, policy, intern);
+        lexer.setMemoryLimit(below(2) ? SIZE_MAX : 0);
+        lexer.setSourceCode(text);
+        for (unsigned threads = 2; threads <= 4; ++threads) {
+            lexer.analyzeParallel(threads);
+            if (!same("analyzeParallel(" + to_string(threads) + ") differs from analyze()", expected,
+                      describeResults(lexer, SYMBOLS_BY_ID))) {
+                return false;
             }
-            // 2. Skip comments
-            if (c == '/' && i + 1 < n && sourceCode[i+1] == '/') {
-                // single-line comment
-                i += 2;
-                while (i < n && sourceCode[i] != '\n') {
-                    i++;
-                }
-                continue;
+        }
+        lexer.analyze();
+        return same("analyze() after analyzeParallel() differs", expected, describeResults(lexer, SYMBOLS_BY_ID));
+    }
+    
+    // Everything pulled through a TokenStream, peeking a random distance
+    // ahead before each token; what peek() showed must be what next() gives
+    bool checkPull(const string& text, const SelfTestPolicy& policy, bool intern, const string& expected) {
+        LexicalAnalyzer lexer;
+        configure(lexer, policy, intern);
+        lexer.setSourceCode(text);
+        LexicalAnalyzer::TokenStream in = lexer.tokenStream();
+        vector<Token> pulled;
+        vector<pair<size_t, Token> > peeked;
+        while (true) {
+            size_t k = below(LexicalAnalyzer::TokenStream::LOOKAHEAD);
+            if (const Token* ahead = in.peek(k)) {
+                peeked.push_back(make_pair(pulled.size() + k, *ahead));
             }
-            if (c == '/' && i + 1 < n && sourceCode[i+1] == '*') {
-                // multi-line comment
-                i += 2;
-                bool closed = false;
-                while (i < n) {
-                    if (sourceCode[i] == '*' && i + 1 < n && sourceCode[i+1] == '/') {
-                        i += 2;
-                        closed = true;
-                        break;
-                    }
-                    i++;
-                }
-                if (!closed) {
-                    addError("/*... (unterminated comment)");
-                }
-                continue;
+            Token tok;
+            if (!in.next(tok)) break;
+            pulled.push_back(tok);
+        }
+        for (size_t j = 0; j < peeked.size(); ++j) {
+            const Token& tok = peeked[j].second;
+            if (peeked[j].first >= pulled.size() || pulled[peeked[j].first].offset != tok.offset) {
+                return same("TokenStream::peek() differs from next()", "token at " + to_string(peeked[j].first),
+                            "token at offset " + to_string(tok.offset));
             }
-            // 3. Identifier or Keyword
-            if (isalpha(c) || c == '_') {
-                string lexeme;
-                bool underscoreSeen = false;
-                while (i < n && (isalpha(sourceCode[i]) || isdigit(sourceCode[i]) || sourceCode[i] == '_')) {
-                    char ch = sourceCode[i];
-                    lexeme.push_back(ch);
-                    if (ch == '_') underscoreSeen = true;
-                    i++;
-                }
-                if (isKeyword(lexeme)) {
-                    addToken(lexeme, "Keyword");
-                } else if (underscoreSeen) {
-                    addToken(lexeme, "Identifier");
-                } else {
-                    addError(lexeme);
-                }
-                continue;
+        }
+        return same("TokenStream differs from analyze()", expected, describeResults(lexer, SYMBOLS_BY_ID, &pulled));
+    }
+    
+#ifndef LEXER_NO_STATS
+    // Attaching counters must not change the results, and unless a cutoff
+    // stops the scan every byte of the input belongs to exactly one counted
+    // lexeme
+    bool checkStats(const string& text, const SelfTestPolicy& policy, bool intern, const string& expected) {
+        LexicalAnalyzer lexer;
+        LexStats stats;
+        configure(lexer, policy, intern);
+        lexer.setStats(&stats);
+        lexer.setSourceCode(text);
+        lexer.analyze();
+        if (!same("analyze() with statistics differs from without", expected,
+                  describeResults(lexer, SYMBOLS_BY_ID))) {
+            return false;
+        }
+        if (policy.maxErrors != 0) return true;
+        uint64_t total = 0;
+        for (int k = 0; k < NUM_ACCEPT_KINDS; ++k) total += stats.bytes[k];
+        return same("statistics do not add up to the input size", to_string(text.size()), to_string(total));
+    }
+#endif
+    
+    // analyze() into a sink, then analyzeStream() fed through a pipe in
+    // random pieces; neither interns symbols
+    bool checkSinks(const string& text, const SelfTestPolicy& policy, const string& expected) {
+        LexicalAnalyzer lexer;
+        configure(lexer, policy, true);
+        lexer.setSourceCode(text);
+        DescribingSink sink(&lexer);
+        lexer.analyze(&sink);
+        ostringstream counts;
+        describeCounts(counts, lexer);
+        if (!same("analyze() into a sink differs from analyze()", expected, sink.str() + counts.str())) {
+            return false;
+        }
+#ifdef LEXER_HAVE_MMAP
+        const size_t blockSizes[] = { 1, 7, 4096 };
+        for (size_t b = 0; b < 3; ++b) {
+            int fds[2];
+            if (pipe(fds) != 0) {
+                cerr << "selftest: pipe() failed" << endl;
+                return false;
             }
-            // 4. Number (integer, decimal, or exponent)
-            if (isdigit(c) || ((c == '+' || c == '-') && i+1 < n && isdigit(sourceCode[i+1]))) {
-                string lexeme;
-                int state = 0;
-                bool numberValid = true;
-                while (i < n && numberValid) {
-                    char ch = sourceCode[i];
-                    switch (state) {
-                        case 0:  // start
-                            if (ch == '+' || ch == '-') {
-                                lexeme.push_back(ch);
-                                state = 1;
-                                i++;
-                            } else if (isdigit(ch)) {
-                                lexeme.push_back(ch);
-                                state = 2;
-                                i++;
-                            } else {
-                                numberValid = false;
-                            }
-                            break;
-                        case 1:  // sign read, need a digit
-                            if (isdigit(ch)) {
-                                lexeme.push_back(ch);
-                                state = 2;
-                                i++;
-                            } else {
-                                numberValid = false;
-                            }
-                            break;
-                        case 2:  // integer part
-                            if (isdigit(ch)) {
-                                lexeme.push_back(ch);
-                                // stay in state 2
-                                i++;
-                            } else if (ch == '.') {
-                                lexeme.push_back(ch);
-                                state = 3;
-                                i++;
-                            } else if (ch == 'E' || ch == 'e') {
-                                lexeme.push_back(ch);
-                                state = 5;
-                                i++;
-                            } else {
-                                // token ends as integer
-                                goto END_NUM;  // break out to finalize
-                            }
-                            break;
-                        case 3:  // decimal point seen, expect fraction digit
-                            if (isdigit(ch)) {
-                                lexeme.push_back(ch);
-                                state = 4;
-                                i++;
-                            } else {
-                                numberValid = false;
-                            }
-                            break;
-                        case 4:  // fractional part
-                            if (isdigit(ch)) {
-                                lexeme.push_back(ch);
-                                i++;
-                            } else if (ch == 'E' || ch == 'e') {
-                                lexeme.push_back(ch);
-                                state = 5;
-                                i++;
-                            } else {
-                                // token ends as decimal
-                                goto END_NUM;
-                            }
-                            break;
-                        case 5:  // exponent marker seen
-                            if (ch == '+' || ch == '-') {
-                                lexeme.push_back(ch);
-                                state = 6;
-                                i++;
-                            } else if (isdigit(ch)) {
-                                lexeme.push_back(ch);
-                                state = 7;
-                                i++;
-                            } else {
-                                numberValid = false;
-                            }
-                            break;
-                        case 6:  // exponent sign seen, expect digit
-                            if (isdigit(ch)) {
-                                lexeme.push_back(ch);
-                                state = 7;
-                                i++;
-                            } else {
-                                numberValid = false;
-                            }
-                            break;
-                        case 7:  // exponent digits
-                            if (isdigit(ch)) {
-                                lexeme.push_back(ch);
-                                i++;
-                            } else {
-                                // token ends after exponent
-                                goto END_NUM;
-                            }
-                            break;
-                    }
-                }
-                END_NUM:
-                // Check if ended in a valid accepting state
-                if (numberValid && (state == 2 || state == 4 || state == 7)) {
-                    addToken(lexeme, "Number");
-                } else {
-                    addError(lexeme);
+            uint32_t pieceSeed = rng();
+            thread writer([&text, &fds, pieceSeed]() {
+                mt19937 pieces(pieceSeed);
+                for (size_t k = 0; k < text.size(); ) {
+                    ssize_t put = write(fds[1], text.data() + k, min(text.size() - k, (size_t)(1 + pieces() % 5000)));
+                    if (put <= 0) break;
+                    k += put;
                 }
-                continue;
+                close(fds[1]);
+            });
+            DescribingSink streamed(NULL);
+            bool ok = lexer.analyzeStream(fds[0], &streamed, blockSizes[b]);
+            // the max-errors cutoff stops reading early
+            char rest[4096];
+            while (read(fds[0], rest, sizeof(rest)) > 0) {}
+            writer.join();
+            close(fds[0]);
+            counts.str("");
+            describeCounts(counts, lexer);
+            if (!ok) {
+                cerr << "selftest: analyzeStream() failed to read" << endl;
+                return false;
             }
-            // 5. Operators and Punctuation
-            // Multi-character operators handled with lookahead
-            string opLex;
-            switch (c) {
-                case '!':
-                    if (i+1 < n && sourceCode[i+1] == '=') {
-                        opLex = "!=";
-                        i += 2;
-                        addToken(opLex, "Operator");
-                    } else {
-                        opLex = "!";
-                        i++;
-                        addError(opLex);
-                    }
-                    break;
-                case '=':
-                    if (i+1 < n && sourceCode[i+1] == '=') {
-                        opLex = "=="; i += 2; addToken(opLex, "Operator");
-                    } else if (i+1 < n && sourceCode[i+1] == '+') {
-                        opLex = "=+"; i += 2; addToken(opLex, "Operator");
-                    } else if (i+1 < n && sourceCode[i+1] == '>') {
-                        opLex = "=>"; i += 2; addToken(opLex, "Operator");
-                    } else if (i+1 < n && sourceCode[i+1] == '<') {
-                        opLex = "=<"; i += 2; addToken(opLex, "Operator");
-                    } else if (i+1 < n && sourceCode[i+1] == ':' && i+2 < n && sourceCode[i+2] == '=') {
-                        opLex = "=:="; i += 3; addToken(opLex, "Operator");
-                    } else {
-                        opLex = "="; i++; addError(opLex);
-                    }
-                    break;
-                case '<':
-                    if (i+1 < n && sourceCode[i+1] == '>') {
-                        opLex = "<>"; i += 2; addToken(opLex, "Operator");
-                    } else {
-                        // treat single '<' as punctuation (opening angle bracket)
-                        opLex = "<"; i++; addToken(opLex, "Punctuation");
-                    }
-                    break;
-                case '>':
-                    if (i+1 < n && sourceCode[i+1] == '>') {
-                        opLex = ">>"; i += 2; addToken(opLex, "Operator");
-                    } else {
-                        opLex = ">"; i++; addToken(opLex, "Punctuation");
-                    }
-                    break;
-                case '+':
-                    if (i+1 < n && sourceCode[i+1] == '+') {
-                        opLex = "++"; i += 2; addToken(opLex, "Operator");
-                    } else {
-                        opLex = "+"; i++; addToken(opLex, "Operator");
-                    }
-                    break;
-                case '-':
-                    if (i+1 < n && sourceCode[i+1] == '-') {
-                        opLex = "--"; i += 2; addToken(opLex, "Operator");
-                    } else {
-                        opLex = "-"; i++; addToken(opLex, "Operator");
-                    }
-                    break;
-                case '&':
-                    if (i+1 < n && sourceCode[i+1] == '&') {
-                        opLex = "&&"; i += 2; addToken(opLex, "Operator");
-                    } else {
-                        opLex = "&"; i++; addError(opLex);
-                    }
-                    break;
-                case '|':
-                    if (i+1 < n && sourceCode[i+1] == '|') {
-                        opLex = "||"; i += 2; addToken(opLex, "Operator");
-                    } else {
-                        opLex = "|"; i++; addError(opLex);
-                    }
-                    break;
-                case '*':
-                    opLex = "*"; i++; addToken(opLex, "Operator");
-                    break;
-                case '/':
-                    opLex = "/"; i++; addToken(opLex, "Operator");
-                    break;
-                case '%':
-                    opLex = "%"; i++; addToken(opLex, "Operator");
-                    break;
-                case ':':
-                    if (i+1 < n && sourceCode[i+1] == ':') {
-                        opLex = "::"; i += 2; addToken(opLex, "Operator");
-                    } else {
-                        opLex = ":"; i++; addToken(opLex, "Operator");
-                    }
-                    break;
-                case '{': case '}': case '[': case ']': case '(': case ')': case ',': case ';':
-                    // punctuation tokens
-                    opLex = string(1, c);
-                    i++;
-                    addToken(opLex, "Punctuation");
-                    break;
-                default:
-                    // any other character is unrecognized
-                    opLex = string(1, c);
-                    i++;
-                    addError(opLex);
-                    break;
+            if (!same("analyzeStream(" + to_string(blockSizes[b]) + ") differs from analyze()", expected,
+                      streamed.str() + counts.str())) {
+                return false;
             }
-            // continue the while loop after handling operator/punctuation
         }
+#endif
+        return true;
     }
     
-    // Utility methods to retrieve or display the results:
-    void printAllTokens() {
-        for (int j = 0; j < tokenCount; ++j) {
-            cout << tokens[j].lexeme << " -> " << tokens[j].type << endl;
-        }
-        if (tokenCount == 0) {
-            cout << "(No tokens)" << endl;
+    // Random edits, mostly close to each other, compared against a fresh
+    // analysis now and then; writeResults() closes the gaps in between, in
+    // either error format
+    bool checkEdits(const string& text, const SelfTestPolicy& policy, bool intern, LexicalAnalyzer& lexer, int edits) {
+        static const char* const pieces[] = {
+            "/*", "*/", "=", ":", "=:", "a", "_", "1", "e", "+", ".", " ", "\n", "//", "x_y", "2.5E+10", "*", "/",
+            "if", "&", "#"
+        };
+        string current = text;
+        size_t at = below(current.size() + 1);
+        for (int e = 0; e < edits; ++e) {
+            at = below(4) ? min(current.size(), at + below(40) - min(at, (size_t)20)) : below(current.size() + 1);
+            size_t removed = min(current.size() - at, below(5));
+            string inserted;
+            for (size_t k = below(3); k > 0; --k) {
+                inserted += pieces[below(sizeof(pieces) / sizeof(pieces[0]))];
+            }
+            lexer.applyEdit(at, removed, inserted);
+            current.replace(at, removed, inserted);
+            if (below(4) != 0 && e + 1 < edits) continue;
+            LexicalAnalyzer fresh;
+            configure(fresh, policy, intern);
+            fresh.setSourceCode(current);
+            fresh.analyze();
+            if (!same("applyEdit() differs from analyze()", describeResults(fresh, SYMBOLS_BY_NAME),
+                      describeResults(lexer, SYMBOLS_BY_NAME))) {
+                return false;
+            }
+            if (below(2) == 0) {
+                bool positions = below(2) == 0;
+                fresh.setErrorPositions(positions);
+                lexer.setErrorPositions(positions);
+                ostringstream expected, got;
+                fresh.writeResults(expected, "selftest");
+                lexer.writeResults(got, "selftest");
+                if (!same("writeResults() after applyEdit() differs", expected.str(), got.str())) return false;
+            }
         }
+        return true;
     }
     
-    void viewTokensByType(int typeOption) {
-        string typeName;
-        switch(typeOption) {
-            case 1: typeName = "Identifier"; break;
-            case 2: typeName = "Number"; break;
-            case 3: typeName = "Operator"; break;
-            case 4: typeName = "Punctuation"; break;
-            case 5: typeName = "Keyword"; break;
-            default: return;
-        }
-        bool found = false;
-        cout << typeName << " Tokens:" << endl;
-        for (int j = 0; j < tokenCount; ++j) {
-            if (tokens[j].type == typeName) {
-                cout << tokens[j].lexeme << endl;
-                found = true;
-            }
-        }
-        if (!found) {
-            cout << "(None)" << endl;
+    // A miss that stores the results, then a hit that restores them and
+    // must be editable like a fresh analysis
+    bool checkCache(const string& text, const SelfTestPolicy& policy, bool intern, const string& expected) {
+        ResultCache cache;
+        filesystem::path dir = workDir / "cache";
+        if (!cache.open(dir.string())) {
+            cerr << "selftest: cannot open the cache in " << dir.string() << endl;
+            return false;
+        }
+        for (int pass = 0; pass < 2; ++pass) {
+            LexicalAnalyzer lexer;
+            configure(lexer, policy, intern);
+            lexer.setCache(&cache);
+            lexer.setSourceCode(text);
+#ifndef LEXER_NO_STATS
+            LexStats stats;
+            lexer.setStats(&stats);
+#endif
+            lexer.analyze();
+#ifndef LEXER_NO_STATS
+            lexer.setStats(NULL);
+            if (pass == 1 && stats.cacheHits != 1) {
+                return same("ResultCache missed", "a hit", "a miss");
+            }
+#endif
+            if (!same(pass ? "a ResultCache hit differs from analyze()" : "analyze() with a ResultCache differs",
+                      expected, describeResults(lexer, SYMBOLS_BY_ID))) {
+                return false;
+            }
+            if (pass == 1 && !checkEdits(text, policy, intern, lexer, 3)) return false;
         }
+        return true;
     }
     
-    void printErrors() {
-        if (errorCount == 0) {
-            cout << "No errors found." << endl;
-        } else {
-            cout << "Error tokens:" << endl;
-            for (int j = 0; j < errorCount; ++j) {
-                cout << errors[j] << endl;
+public:
+    SelfTest(uint32_t s, const filesystem::path& dir): seed(s), round(0), workDir(dir) {}
+    
+    // sample_test.txt and tests/fuzz, in name order; empty when run from
+    // elsewhere than the repository root
+    static vector<GoldenCase> goldenCases() {
+        vector<GoldenCase> cases;
+        error_code ec;
+        for (filesystem::directory_iterator it("tests/fuzz", ec), end; !ec && it != end; it.increment(ec)) {
+            filesystem::path input = it->path();
+            filesystem::path stem = input.parent_path() / input.stem();
+            if (input.extension() == ".txt" && stem.extension().empty()) {
+                GoldenCase golden = { input, stem };
+                cases.push_back(golden);
             }
         }
+        if (cases.empty()) return cases;
+        sort(cases.begin(), cases.end(), [](const GoldenCase& a, const GoldenCase& b) { return a.input < b.input; });
+        GoldenCase sample = { "sample_test.txt", "tests/sample_test" };
+        cases.insert(cases.begin(), sample);
+        return cases;
     }
     
-    bool exportToFiles(const string& tokenFile = "Token.txt", const string& errorFile = "Error.txt") {
-        ofstream fout1(tokenFile.c_str());
-        if (!fout1) return false;
-        for (int j = 0; j < tokenCount; ++j) {
-            fout1 << tokens[j].lexeme << " -> " << tokens[j].type << endl;
+    bool runGolden(const vector<GoldenCase>& cases) {
+        for (size_t k = 0; k < cases.size(); ++k) {
+            if (!checkGolden(cases[k])) return false;
         }
-        fout1.close();
-        ofstream fout2(errorFile.c_str());
-        if (!fout2) return false;
-        for (int j = 0; j < errorCount; ++j) {
-            fout2 << errors[j] << endl;
+        return true;
+    }
+    
+    bool run(int rounds) {
+        for (round = 0; round < rounds; ++round) {
+            rng.seed(seed * 1000003u + round);
+            bool large = round % 10 == 9;
+            string text = randomInput(large);
+            for (size_t p = 0; p < sizeof(selfTestPolicies) / sizeof(selfTestPolicies[0]); ++p) {
+                const SelfTestPolicy& policy = selfTestPolicies[p];
+                for (int intern = 0; intern < 2; ++intern) {
+                    context = "--seed " + to_string(seed) + ", round " + to_string(round) + ", "
+                        + to_string(text.size()) + " bytes, recovery " + to_string((int)policy.recovery)
+                        + ", max errors " + to_string(policy.maxErrors) + ", interning " + (intern ? "on" : "off");
+                    LexicalAnalyzer reference;
+                    configure(reference, policy, intern != 0);
+                    reference.setSourceCode(text);
+                    reference.analyze();
+                    string expected = describeResults(reference, SYMBOLS_BY_ID);
+                    if (large && !checkParallel(text, policy, intern != 0, expected)) return false;
+                    if (!checkPull(text, policy, intern != 0, expected)) return false;
+#ifndef LEXER_NO_STATS
+                    if (!checkStats(text, policy, intern != 0, expected)) return false;
+#endif
+                    if (!intern && !checkSinks(text, policy, describeResults(reference, SYMBOLS_NONE))) return false;
+                    if (!checkCache(text, policy, intern != 0, expected)) return false;
+                    if (!checkEdits(text, policy, intern != 0, reference, large ? 4 : 40)) return false;
+                }
+            }
         }
-        fout2.close();
         return true;
     }
 };
 
-int main() {
+int runSelfTest(int argc, char* argv[]) {
+    int rounds = 100;
+    uint32_t seed = 1;
+    for (int a = 2; a < argc; ++a) {
+        string arg = argv[a];
+        if (arg == "--rounds" && a + 1 < argc) {
+            rounds = max(0, atoi(argv[++a]));
+        } else if (arg == "--seed" && a + 1 < argc) {
+            seed = (uint32_t)atol(argv[++a]);
+        } else {
+            cerr << "Usage: main --selftest [--rounds N] [--seed N]" << endl;
+            return 1;
+        }
+    }
+    vector<GoldenCase> cases = SelfTest::goldenCases();
+    if (cases.empty()) {
+        cerr << "selftest: no golden files in tests/fuzz; run it from the repository root" << endl;
+        return 1;
+    }
+    filesystem::path dir = makeTempDirectory("lexer-selftest-");
+    if (dir.empty()) {
+        cerr << "Cannot create a temporary directory for the self-test" << endl;
+        return 1;
+    }
+    SelfTest test(seed, dir);
+    bool ok = test.runGolden(cases) && test.run(rounds);
+    error_code ec;
+    filesystem::remove_all(dir, ec);
+    if (ok) {
+        cout << "selftest: " << cases.size() << " golden inputs and " << rounds << " rounds passed" << endl;
+    }
+    return ok ? 0 : 1;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && strcmp(argv[1], "--bench-keywords") == 0) {
+        benchmarkKeywords();
+        return 0;
+    }
+    if (argc > 1 && (strcmp(argv[1], "--bench") == 0 || strcmp(argv[1], "--gen-corpus") == 0)) {
+        return runBenchmark(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "--selftest") == 0) {
+        return runSelfTest(argc, argv);
+    }
+    if (argc > 1) {
+        return runBatch(argc, argv);
+    }
+    
     LexicalAnalyzer lexer;
     string choice;
     bool running = true;
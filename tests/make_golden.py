@@ -0,0 +1,127 @@
+#!/usr/bin/env python3
+"""
+Golden outputs for main --selftest
+
+Writes the fuzzed inputs tests/fuzz/NNN.txt and, for them and for
+sample_test.txt, the Token.txt and Error.txt that the original hand-written
+scanner exports. Its main.cpp is the one in the first commit:
+
+    git show $(git rev-list --max-parents=0 HEAD):main.cpp > baseline.cpp
+    g++ -O2 -o baseline baseline.cpp
+    python3 tests/make_golden.py ./baseline
+
+The old scanner drops tokens past 1000 and errors past 500, so the inputs are
+kept well below that. Every input ends with a newline, which the old
+loadFromFile() added to the last line.
+"""
+
+import os
+import random
+import shutil
+import subprocess
+import sys
+import tempfile
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+FUZZ_DIR = os.path.join(ROOT, "tests", "fuzz")
+CASES = 48
+SEED = 20250629
+MAX_LINES = 800
+
+WORDS = ["_count", "_result", "x_y", "a_", "_", "__", "invalidID", "abc", "E", "e", "Ee1", "_E2", "z9_"]
+KEYWORDS = ["agar", "magar", "loop", "if", "else", "while", "int", "true", "false", "return", "namespace", "do"]
+NUMBERS = ["0", "7", "10", "3.14", "-2.5E+10", "2.5E+10", "1e5", "1E-3", "3.14E", "12.", ".5", "1.e5", "1E+",
+           "-7", "+3", "00", "9.9e9", "1.2.3", "5E5E5"]
+OPERATORS = ["=:=", "=:", "=", "==", "!=", "!", "<", "<=", "<<", ">", ">=", ">>", "+", "++", "+=", "-", "--",
+             "-=", "*", "/", "%", ":", "::", "&", "&&", "|", "||", "^", "~", "?", "."]
+PUNCTUATION = ["{", "}", "[", "]", "(", ")", ",", ";"]
+OTHER = ["#", "@", "$", "`", "\\", "'", "\"", "\x80", "\xe9", "\xff", "\x01", "\x7f"]
+SPACE = [" ", "  ", "\t", "\n", "\r\n", "\v", "\f", "\n\n"]
+SOUP = "ab_xyzE1290.+-=:!&|<>/*;,(){}[] \n\t\r\"#\x80"
+
+
+def comment(rng):
+    body = "".join(rng.choice(WORDS + KEYWORDS + NUMBERS + OPERATORS + [" ", "*", "/", "**"])
+                   for _ in range(rng.randrange(6)))
+    if rng.randrange(2):
+        return "//" + body.replace("\n", " ") + "\n"
+    # now and then left open, to the end of the input
+    return "/*" + body + ("" if rng.randrange(12) == 0 else "*/")
+
+
+def token_mix(rng):
+    size = rng.randrange(64, 2000)
+    pieces = [WORDS, KEYWORDS, NUMBERS, OPERATORS, PUNCTUATION, OTHER, SPACE]
+    weights = [rng.randrange(1, 8) for _ in pieces]
+    out = []
+    length = 0
+    while length < size:
+        if rng.randrange(25) == 0:
+            piece = comment(rng)
+        else:
+            piece = rng.choice(rng.choices(pieces, weights)[0])
+        if rng.randrange(3) == 0:
+            piece += rng.choice(SPACE)
+        out.append(piece)
+        length += len(piece)
+    return "".join(out)
+
+
+def byte_soup(rng):
+    size = rng.randrange(64, 700)
+    return "".join(rng.choice(SOUP) for _ in range(size))
+
+
+def random_bytes(rng):
+    size = rng.randrange(64, 350)
+    return "".join(chr(rng.randrange(1, 256)) for _ in range(size))
+
+
+def run_baseline(binary, path, work):
+    for name in ("Token.txt", "Error.txt"):
+        if os.path.exists(os.path.join(work, name)):
+            os.remove(os.path.join(work, name))
+    menu = "1\n2\n%s\n2\n5\n6\n" % path
+    subprocess.run([binary], input=menu.encode(), cwd=work, stdout=subprocess.DEVNULL, check=True)
+    with open(os.path.join(work, "Token.txt"), "rb") as f:
+        tokens = f.read()
+    with open(os.path.join(work, "Error.txt"), "rb") as f:
+        errors = f.read()
+    if tokens.count(b"\n") > MAX_LINES or errors.count(b"\n") > MAX_LINES // 2:
+        sys.exit("%s: too many tokens or errors for the old scanner" % path)
+    return tokens, errors
+
+
+def write_golden(binary, source, stem, work):
+    tokens, errors = run_baseline(binary, source, work)
+    with open(stem + ".Token.txt", "wb") as f:
+        f.write(tokens)
+    with open(stem + ".Error.txt", "wb") as f:
+        f.write(errors)
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.exit("usage: make_golden.py BASELINE_BINARY")
+    binary = os.path.abspath(sys.argv[1])
+    rng = random.Random(SEED)
+    makers = [token_mix, byte_soup, random_bytes]
+    if os.path.isdir(FUZZ_DIR):
+        shutil.rmtree(FUZZ_DIR)
+    os.makedirs(FUZZ_DIR)
+    work = tempfile.mkdtemp(prefix="lexer-golden-")
+    try:
+        write_golden(binary, os.path.join(ROOT, "sample_test.txt"),
+                     os.path.join(ROOT, "tests", "sample_test"), work)
+        for k in range(CASES):
+            text = makers[k % len(makers)](rng) + "\n"
+            path = os.path.join(FUZZ_DIR, "%03d.txt" % k)
+            with open(path, "wb") as f:
+                f.write(text.encode("latin-1"))
+            write_golden(binary, path, os.path.join(FUZZ_DIR, "%03d" % k), work)
+    finally:
+        shutil.rmtree(work)
+
+
+if __name__ == "__main__":
+    main()